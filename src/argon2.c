@@ -0,0 +1,355 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/* Argon2id v1.3 (RFC 9106) with the lanes of each slice computed in
+ * parallel by threads that live for the whole hash and meet at every
+ * slice boundary. libsodium only implements a single lane, for p=1 this
+ * gives exactly the same output as crypto_pwhash(..., ALG_ARGON2ID13).
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sodium.h>
+#include "sphinx.h"
+#include "common.h"
+
+#define BLOCK_WORDS 128
+#define BLOCK_BYTES (BLOCK_WORDS*8)
+#define SYNC_POINTS 4
+#define ARGON2_VERSION 0x13
+#define ARGON2_ID 2
+
+typedef struct {
+  uint64_t v[BLOCK_WORDS];
+} Block;
+
+// the threads filling lanes wait here until all finished the slice
+typedef struct {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  unsigned n, waiting, gen;
+} Barrier;
+
+typedef struct {
+  Block *memory;
+  uint32_t passes, lanes, lane_length, segment_length, blocks;
+  unsigned threads;
+  Barrier sync;
+} Instance;
+
+typedef struct {
+  Instance *in;
+  unsigned t;
+} Worker;
+
+static uint64_t load64(const uint8_t *p) {
+  uint64_t r=0;
+  int i;
+  for(i=7;i>=0;i--) r=(r<<8)|p[i];
+  return r;
+}
+
+static void store64(uint8_t *p, uint64_t v) {
+  int i;
+  for(i=0;i<8;i++,v>>=8) p[i]=v&0xff;
+}
+
+static void store32(uint8_t *p, uint32_t v) {
+  int i;
+  for(i=0;i<4;i++,v>>=8) p[i]=v&0xff;
+}
+
+// H' - the variable length hash function
+static void blake2b_long(uint8_t *out, const uint32_t outlen, const uint8_t *in, const size_t inlen) {
+  crypto_generichash_state state;
+  uint8_t len[4];
+  store32(len, outlen);
+  if(outlen<=crypto_generichash_BYTES_MAX) {
+    crypto_generichash_init(&state, NULL, 0, outlen);
+    crypto_generichash_update(&state, len, sizeof len);
+    crypto_generichash_update(&state, in, inlen);
+    crypto_generichash_final(&state, out, outlen);
+    sodium_memzero(&state, sizeof state);
+    return;
+  }
+  uint8_t v[crypto_generichash_BYTES_MAX];
+  uint32_t left=outlen;
+  crypto_generichash_init(&state, NULL, 0, sizeof v);
+  crypto_generichash_update(&state, len, sizeof len);
+  crypto_generichash_update(&state, in, inlen);
+  crypto_generichash_final(&state, v, sizeof v);
+  memcpy(out, v, sizeof v / 2);
+  out+=sizeof v / 2;
+  left-=sizeof v / 2;
+  while(left>sizeof v) {
+    crypto_generichash(v, sizeof v, v, sizeof v, NULL, 0);
+    memcpy(out, v, sizeof v / 2);
+    out+=sizeof v / 2;
+    left-=sizeof v / 2;
+  }
+  crypto_generichash(out, left, v, sizeof v, NULL, 0);
+  sodium_memzero(v, sizeof v);
+  sodium_memzero(&state, sizeof state);
+}
+
+static uint64_t rotr64(const uint64_t w, const unsigned c) {
+  return (w >> c) | (w << (64 - c));
+}
+
+static uint64_t fBlaMka(const uint64_t x, const uint64_t y) {
+  return x + y + 2 * (x & 0xffffffff) * (y & 0xffffffff);
+}
+
+#define G(a, b, c, d)                 \
+  do {                                \
+    a = fBlaMka(a, b);                \
+    d = rotr64(d ^ a, 32);            \
+    c = fBlaMka(c, d);                \
+    b = rotr64(b ^ c, 24);            \
+    a = fBlaMka(a, b);                \
+    d = rotr64(d ^ a, 16);            \
+    c = fBlaMka(c, d);                \
+    b = rotr64(b ^ c, 63);            \
+  } while(0)
+
+#define ROUND(v0, v1, v2, v3, v4, v5, v6, v7, v8, v9, v10, v11, v12, v13, v14, v15) \
+  do {                                \
+    G(v0, v4, v8, v12);               \
+    G(v1, v5, v9, v13);               \
+    G(v2, v6, v10, v14);              \
+    G(v3, v7, v11, v15);              \
+    G(v0, v5, v10, v15);              \
+    G(v1, v6, v11, v12);              \
+    G(v2, v7, v8, v13);               \
+    G(v3, v4, v9, v14);               \
+  } while(0)
+
+// next = G(prev, ref) or next ^= G(prev, ref) if with_xor
+static void fill_block(const Block *prev, const Block *ref, Block *next, const int with_xor) {
+  Block r, tmp;
+  unsigned i;
+  for(i=0;i<BLOCK_WORDS;i++) r.v[i]=ref->v[i]^prev->v[i];
+  tmp=r;
+  if(with_xor) for(i=0;i<BLOCK_WORDS;i++) tmp.v[i]^=next->v[i];
+
+  uint64_t *v=r.v;
+  for(i=0;i<8;i++) {
+    ROUND(v[16*i], v[16*i+1], v[16*i+2], v[16*i+3],
+          v[16*i+4], v[16*i+5], v[16*i+6], v[16*i+7],
+          v[16*i+8], v[16*i+9], v[16*i+10], v[16*i+11],
+          v[16*i+12], v[16*i+13], v[16*i+14], v[16*i+15]);
+  }
+  for(i=0;i<8;i++) {
+    ROUND(v[2*i], v[2*i+1], v[2*i+16], v[2*i+17],
+          v[2*i+32], v[2*i+33], v[2*i+48], v[2*i+49],
+          v[2*i+64], v[2*i+65], v[2*i+80], v[2*i+81],
+          v[2*i+96], v[2*i+97], v[2*i+112], v[2*i+113]);
+  }
+
+  for(i=0;i<BLOCK_WORDS;i++) next->v[i]=tmp.v[i]^r.v[i];
+}
+
+static void next_addresses(Block *address, Block *input, const Block *zero) {
+  input->v[6]++;
+  fill_block(zero, input, address, 0);
+  fill_block(zero, address, address, 0);
+}
+
+static uint32_t index_alpha(const Instance *in, const uint32_t pass, const uint32_t slice,
+                            const uint32_t index, const uint32_t pseudo_rand, const int same_lane) {
+  uint32_t area, start=0;
+  if(pass==0) {
+    if(slice==0) area=index-1;
+    else if(same_lane) area=slice*in->segment_length+index-1;
+    else area=slice*in->segment_length-(index==0);
+  } else {
+    if(same_lane) area=in->lane_length-in->segment_length+index-1;
+    else area=in->lane_length-in->segment_length-(index==0);
+    if(slice!=SYNC_POINTS-1) start=(slice+1)*in->segment_length;
+  }
+  uint64_t rel=pseudo_rand;
+  rel=(rel*rel)>>32;
+  rel=area-1-((area*rel)>>32);
+  return (start+rel)%in->lane_length;
+}
+
+// fills one segment of one lane, lanes of the same slice are independent
+static void fill_segment(const Instance *in, const uint32_t pass, const uint32_t slice,
+                         const uint32_t lane) {
+  const int independent=(pass==0 && slice<SYNC_POINTS/2);
+  Block address, input, zero;
+  uint32_t i, start=0;
+
+  if(independent) {
+    memset(&zero, 0, sizeof zero);
+    memset(&input, 0, sizeof input);
+    input.v[0]=pass;
+    input.v[1]=lane;
+    input.v[2]=slice;
+    input.v[3]=in->blocks;
+    input.v[4]=in->passes;
+    input.v[5]=ARGON2_ID;
+  }
+  if(pass==0 && slice==0) {
+    start=2;
+    if(independent) next_addresses(&address, &input, &zero);
+  }
+
+  uint32_t cur=lane*in->lane_length+slice*in->segment_length+start;
+  uint32_t prev=(cur%in->lane_length==0)?cur+in->lane_length-1:cur-1;
+  for(i=start;i<in->segment_length;i++,cur++,prev++) {
+    if(cur%in->lane_length==1) prev=cur-1;
+    uint64_t pseudo_rand;
+    if(independent) {
+      if(i%BLOCK_WORDS==0) next_addresses(&address, &input, &zero);
+      pseudo_rand=address.v[i%BLOCK_WORDS];
+    } else {
+      pseudo_rand=in->memory[prev].v[0];
+    }
+    uint32_t ref_lane=(pass==0 && slice==0)?lane:(pseudo_rand>>32)%in->lanes;
+    uint32_t ref_index=index_alpha(in, pass, slice, i, pseudo_rand&0xffffffff, ref_lane==lane);
+    fill_block(&in->memory[prev], &in->memory[in->lane_length*ref_lane+ref_index],
+               &in->memory[cur], pass!=0);
+  }
+  if(independent) {
+    sodium_memzero(&address, sizeof address);
+    sodium_memzero(&input, sizeof input);
+  }
+}
+
+static void barrier_wait(Barrier *b) {
+  pthread_mutex_lock(&b->lock);
+  const unsigned gen=b->gen;
+  if(++b->waiting==b->n) {
+    b->waiting=0;
+    b->gen++;
+    pthread_cond_broadcast(&b->cond);
+  } else {
+    while(gen==b->gen) pthread_cond_wait(&b->cond, &b->lock);
+  }
+  pthread_mutex_unlock(&b->lock);
+}
+
+// thread t fills every threads-th lane of each slice
+static void fill_lanes(Instance *in, const unsigned t) {
+  uint32_t pass, slice, lane;
+  for(pass=0;pass<in->passes;pass++) {
+    for(slice=0;slice<SYNC_POINTS;slice++) {
+      for(lane=t;lane<in->lanes;lane+=in->threads) fill_segment(in, pass, slice, lane);
+      if(in->threads>1) barrier_wait(&in->sync);
+    }
+  }
+}
+
+static void *fill_worker(void *arg) {
+  const Worker *w=arg;
+  // held by sphinx_argon2id() until the number of threads is known
+  pthread_mutex_lock(&w->in->sync.lock);
+  pthread_mutex_unlock(&w->in->sync.lock);
+  fill_lanes(w->in, w->t);
+  return NULL;
+}
+
+int sphinx_argon2id(uint8_t *out, const uint32_t outlen,
+                    const uint8_t *pwd, const size_t pwd_len,
+                    const uint8_t *salt, const size_t salt_len,
+                    const uint8_t *secret, const size_t secret_len,
+                    const uint8_t *ad, const size_t ad_len,
+                    const uint32_t t_cost, const uint32_t m_cost, const uint32_t lanes) {
+  if(outlen<crypto_generichash_BYTES_MIN || t_cost<1 || lanes<1 ||
+     lanes>SPHINX_PWHASH_LANES_MAX || m_cost<8*lanes || salt_len<8)
+    return -1;
+
+  Instance in;
+  in.passes=t_cost;
+  in.lanes=lanes;
+  in.segment_length=m_cost/(lanes*SYNC_POINTS);
+  in.lane_length=in.segment_length*SYNC_POINTS;
+  in.blocks=in.lane_length*lanes;
+  in.memory=malloc((size_t) in.blocks*sizeof(Block));
+  if(in.memory==NULL) return -1;
+
+  // H0
+  uint8_t h0[crypto_generichash_BYTES_MAX+8], w[4];
+  crypto_generichash_state state;
+  crypto_generichash_init(&state, NULL, 0, crypto_generichash_BYTES_MAX);
+  const uint32_t params[]={ lanes, outlen, m_cost, t_cost, ARGON2_VERSION, ARGON2_ID };
+  unsigned i;
+  for(i=0;i<sizeof params/sizeof params[0];i++) {
+    store32(w, params[i]);
+    crypto_generichash_update(&state, w, sizeof w);
+  }
+  const struct { const uint8_t *p; size_t len; } inputs[]={
+    { pwd, pwd_len }, { salt, salt_len }, { secret, secret_len }, { ad, ad_len } };
+  for(i=0;i<sizeof inputs/sizeof inputs[0];i++) {
+    store32(w, (uint32_t) inputs[i].len);
+    crypto_generichash_update(&state, w, sizeof w);
+    if(inputs[i].len>0) crypto_generichash_update(&state, inputs[i].p, inputs[i].len);
+  }
+  crypto_generichash_final(&state, h0, crypto_generichash_BYTES_MAX);
+  sodium_memzero(&state, sizeof state);
+
+  // first two blocks of each lane
+  uint8_t bytes[BLOCK_BYTES];
+  uint32_t l, j;
+  for(l=0;l<lanes;l++) {
+    for(j=0;j<2;j++) {
+      store32(h0+crypto_generichash_BYTES_MAX, j);
+      store32(h0+crypto_generichash_BYTES_MAX+4, l);
+      blake2b_long(bytes, BLOCK_BYTES, h0, sizeof h0);
+      for(i=0;i<BLOCK_WORDS;i++)
+        in.memory[l*in.lane_length+j].v[i]=load64(bytes+8*i);
+    }
+  }
+  sodium_memzero(h0, sizeof h0);
+
+  // lanes-1 workers and the calling thread, if threads cannot be
+  // created the lanes are shared among the ones that could
+  pthread_t workers[SPHINX_PWHASH_LANES_MAX];
+  Worker args[SPHINX_PWHASH_LANES_MAX];
+  pthread_mutex_init(&in.sync.lock, NULL);
+  pthread_cond_init(&in.sync.cond, NULL);
+  in.sync.waiting=in.sync.gen=0;
+  pthread_mutex_lock(&in.sync.lock);
+  for(in.threads=1;in.threads<lanes;in.threads++) {
+    args[in.threads]=(Worker) { &in, in.threads };
+    if(pthread_create(&workers[in.threads], NULL, fill_worker, &args[in.threads])!=0) break;
+  }
+  in.sync.n=in.threads;
+  pthread_mutex_unlock(&in.sync.lock);
+  fill_lanes(&in, 0);
+  for(l=1;l<in.threads;l++) pthread_join(workers[l], NULL);
+  pthread_cond_destroy(&in.sync.cond);
+  pthread_mutex_destroy(&in.sync.lock);
+
+  // xor of the last blocks of all lanes
+  Block final=in.memory[in.lane_length-1];
+  for(l=1;l<lanes;l++)
+    for(i=0;i<BLOCK_WORDS;i++)
+      final.v[i]^=in.memory[l*in.lane_length+in.lane_length-1].v[i];
+  for(i=0;i<BLOCK_WORDS;i++) store64(bytes+8*i, final.v[i]);
+  blake2b_long(out, outlen, bytes, sizeof bytes);
+
+  sodium_memzero(bytes, sizeof bytes);
+  sodium_memzero(&final, sizeof final);
+  sodium_memzero(in.memory, (size_t) in.blocks*sizeof(Block));
+  free(in.memory);
+  return 0;
+}
@@ -0,0 +1,255 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef _WIN32
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sodium.h>
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+#include "sphinx_async.h"
+
+typedef struct Job {
+  struct Job *next;
+  sphinx_async_result result;
+  sphinx_pwhash_params params;
+  uint8_t resp[SPHINX_255_SER_BYTES];
+  uint8_t salt[crypto_pwhash_SALTBYTES];
+  size_t p_len, salt_len;
+  // pwd, and for challenges the salt follow
+  uint8_t data[];
+} Job;
+
+typedef struct {
+  Job *head, *tail;
+} Queue;
+
+struct sphinx_async {
+  pthread_mutex_t lock;
+  pthread_cond_t more;
+  Queue pending, done;
+  int stop;
+  int fd[2]; // eventfd in both, or the two ends of a pipe
+  unsigned nthreads;
+  pthread_t *threads;
+};
+
+static void push(Queue *q, Job *job) {
+  job->next=NULL;
+  if(q->tail) q->tail->next=job;
+  else q->head=job;
+  q->tail=job;
+}
+
+static Job* pop(Queue *q) {
+  Job *job=q->head;
+  if(job!=NULL) {
+    q->head=job->next;
+    if(q->head==NULL) q->tail=NULL;
+  }
+  return job;
+}
+
+static void drain(Queue *q) {
+  Job *job;
+  while((job=pop(q))!=NULL) sodium_free(job);
+}
+
+static void notify(sphinx_async *ctx) {
+#ifdef __linux__
+  const uint64_t one=1;
+  if(write(ctx->fd[1], &one, sizeof one)!=sizeof one) {} // counter cannot overflow in practice
+#else
+  const uint8_t one=1;
+  if(write(ctx->fd[1], &one, sizeof one)!=sizeof one) {} // a full pipe is readable anyway
+#endif
+}
+
+static void clear(sphinx_async *ctx) {
+  uint8_t buf[64];
+  while(read(ctx->fd[0], buf, sizeof buf)>0);
+}
+
+static void run(Job *job) {
+  sphinx_async_result *r=&job->result;
+  if(r->op==SPHINX_ASYNC_CHALLENGE) {
+    r->ret=sphinx_challenge(job->data, job->p_len,
+                            job->salt_len?job->data+job->p_len:NULL, job->salt_len,
+                            r->bfac, r->chal);
+  } else {
+    r->ret=sphinx_finish_params(job->data, job->p_len, r->bfac, job->resp, job->salt,
+                                &job->params, r->rwd);
+  }
+}
+
+static void* worker(void *arg) {
+  sphinx_async *ctx=arg;
+  pthread_mutex_lock(&ctx->lock);
+  for(;;) {
+    while(!ctx->stop && ctx->pending.head==NULL)
+      pthread_cond_wait(&ctx->more, &ctx->lock);
+    if(ctx->stop) break;
+    Job *job=pop(&ctx->pending);
+    pthread_mutex_unlock(&ctx->lock);
+
+    run(job);
+
+    pthread_mutex_lock(&ctx->lock);
+    push(&ctx->done, job);
+    notify(ctx);
+  }
+  pthread_mutex_unlock(&ctx->lock);
+  return NULL;
+}
+
+static int submit(sphinx_async *ctx, Job *job) {
+  pthread_mutex_lock(&ctx->lock);
+  if(ctx->stop) {
+    pthread_mutex_unlock(&ctx->lock);
+    sodium_free(job);
+    return -1;
+  }
+  push(&ctx->pending, job);
+  pthread_cond_signal(&ctx->more);
+  pthread_mutex_unlock(&ctx->lock);
+  return 0;
+}
+
+static Job* new_job(const sphinx_async_op op, const uint64_t tag, const uint8_t *pwd, const size_t p_len, const size_t extra) {
+  if(p_len>SIZE_MAX-sizeof(Job)-extra) return NULL;
+  Job *job=sodium_malloc(sizeof(Job)+p_len+extra);
+  if(job==NULL) return NULL;
+  memset(job, 0, sizeof(Job));
+  job->result.op=op;
+  job->result.tag=tag;
+  job->p_len=p_len;
+  if(p_len>0) memcpy(job->data, pwd, p_len);
+  return job;
+}
+
+int sphinx_async_challenge(sphinx_async *ctx, const uint64_t tag,
+                           const uint8_t *pwd, const size_t p_len,
+                           const uint8_t *salt, const size_t salt_len) {
+  Job *job=new_job(SPHINX_ASYNC_CHALLENGE, tag, pwd, p_len, salt_len);
+  if(job==NULL) return -1;
+  job->salt_len=salt_len;
+  if(salt_len>0) memcpy(job->data+p_len, salt, salt_len);
+  return submit(ctx, job);
+}
+
+int sphinx_async_finish(sphinx_async *ctx, const uint64_t tag,
+                        const uint8_t *pwd, const size_t p_len,
+                        const uint8_t bfac[crypto_core_ristretto255_SCALARBYTES],
+                        const uint8_t resp[crypto_core_ristretto255_BYTES],
+                        const uint8_t salt[crypto_pwhash_SALTBYTES],
+                        const sphinx_pwhash_params *params) {
+  Job *job=new_job(SPHINX_ASYNC_FINISH, tag, pwd, p_len, 0);
+  if(job==NULL) return -1;
+  memcpy(job->result.bfac, bfac, SPHINX_255_SCALAR_BYTES);
+  memcpy(job->resp, resp, SPHINX_255_SER_BYTES);
+  memcpy(job->salt, salt, crypto_pwhash_SALTBYTES);
+  if(params!=NULL) {
+    job->params=*params;
+  } else {
+    const sphinx_pwhash_params interactive=SPHINX_PWHASH_INTERACTIVE;
+    job->params=interactive;
+  }
+  return submit(ctx, job);
+}
+
+size_t sphinx_async_poll(sphinx_async *ctx, sphinx_async_result *results, const size_t max) {
+  size_t n=0;
+  pthread_mutex_lock(&ctx->lock);
+  clear(ctx);
+  Job *job;
+  while(n<max && (job=pop(&ctx->done))!=NULL) {
+    memcpy(&results[n++], &job->result, sizeof job->result);
+    sodium_free(job);
+  }
+  // keep the fd readable if not everything was collected
+  if(ctx->done.head!=NULL) notify(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+  return n;
+}
+
+int sphinx_async_fd(const sphinx_async *ctx) {
+  return ctx->fd[0];
+}
+
+sphinx_async *sphinx_async_new(const unsigned threads) {
+  sphinx_async *ctx=calloc(1, sizeof(sphinx_async));
+  if(ctx==NULL) return NULL;
+  ctx->nthreads=threads?threads:(unsigned) sysconf(_SC_NPROCESSORS_ONLN);
+  if(ctx->nthreads==0) ctx->nthreads=1;
+  ctx->threads=calloc(ctx->nthreads, sizeof(pthread_t));
+  if(ctx->threads==NULL) {
+    free(ctx);
+    return NULL;
+  }
+#ifdef __linux__
+  ctx->fd[0]=ctx->fd[1]=eventfd(0, EFD_NONBLOCK|EFD_CLOEXEC);
+  const int fail=(ctx->fd[0]==-1);
+#else
+  const int fail=(pipe(ctx->fd)!=0 ||
+                  fcntl(ctx->fd[0], F_SETFL, O_NONBLOCK)!=0 ||
+                  fcntl(ctx->fd[1], F_SETFL, O_NONBLOCK)!=0);
+#endif
+  if(fail) {
+    free(ctx->threads);
+    free(ctx);
+    return NULL;
+  }
+  pthread_mutex_init(&ctx->lock, NULL);
+  pthread_cond_init(&ctx->more, NULL);
+
+  unsigned i;
+  for(i=0;i<ctx->nthreads;i++) {
+    if(pthread_create(&ctx->threads[i], NULL, worker, ctx)!=0) {
+      ctx->nthreads=i;
+      sphinx_async_free(ctx);
+      return NULL;
+    }
+  }
+  return ctx;
+}
+
+void sphinx_async_free(sphinx_async *ctx) {
+  if(ctx==NULL) return;
+  pthread_mutex_lock(&ctx->lock);
+  ctx->stop=1;
+  pthread_cond_broadcast(&ctx->more);
+  pthread_mutex_unlock(&ctx->lock);
+
+  unsigned i;
+  for(i=0;i<ctx->nthreads;i++) pthread_join(ctx->threads[i], NULL);
+
+  drain(&ctx->pending);
+  drain(&ctx->done);
+  close(ctx->fd[0]);
+  if(ctx->fd[1]!=ctx->fd[0]) close(ctx->fd[1]);
+  pthread_mutex_destroy(&ctx->lock);
+  pthread_cond_destroy(&ctx->more);
+  free(ctx->threads);
+  free(ctx);
+}
+
+#endif // _WIN32
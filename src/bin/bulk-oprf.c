@@ -0,0 +1,159 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sodium.h>
+#include "../common.h"
+
+/* bulk-oprf - evaluates sphinx_oprf() over a file of records
+ *
+ * every input record is
+ *   k (32 bytes) | pwd_len (2 bytes, big endian) | pwd (pwd_len bytes)
+ * for every record the 32 byte rwd is written to the output in input
+ * order, or a line of hex with -x. The optional -k keyfile is used as
+ * the key of the final hash for all records.
+ */
+
+#define BATCH 65536
+#define HDR (crypto_core_ristretto255_SCALARBYTES+2)
+
+static void usage(const char *prg) {
+  fprintf(stderr, "usage: %s [-t threads] [-k keyfile] [-x] <input> <output>\n", prg);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  unsigned threads=sysconf(_SC_NPROCESSORS_ONLN);
+  const char *keyfile=NULL;
+  int hex=0, opt;
+  while((opt=getopt(argc, argv, "t:k:xh"))!=-1) {
+    switch(opt) {
+    case 't': threads=atoi(optarg); break;
+    case 'k': keyfile=optarg; break;
+    case 'x': hex=1; break;
+    default: usage(argv[0]);
+    }
+  }
+  if(argc-optind!=2) usage(argv[0]);
+  if(sodium_init()==-1) return 1;
+
+  uint8_t key[crypto_generichash_KEYBYTES_MAX];
+  size_t key_len=0;
+  if(keyfile!=NULL) {
+    FILE *f = fopen(keyfile, "r");
+    if(f==NULL) {
+      fprintf(stderr,"could not open %s\n", keyfile);
+      return 1;
+    }
+    key_len=fread(key, 1, sizeof key, f);
+    fclose(f);
+    if(key_len<crypto_generichash_KEYBYTES_MIN) {
+      fprintf(stderr, "expected at least %dB key in %s\n", crypto_generichash_KEYBYTES_MIN, keyfile);
+      return 1;
+    }
+  }
+
+  int fd=open(argv[optind], O_RDONLY);
+  struct stat st;
+  if(fd==-1 || fstat(fd, &st)!=0) {
+    fprintf(stderr,"could not open %s\n", argv[optind]);
+    return 1;
+  }
+  const size_t size=st.st_size;
+  const uint8_t *in=NULL;
+  if(size>0) {
+    in=mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(in==MAP_FAILED) {
+      fprintf(stderr,"could not map %s\n", argv[optind]);
+      return 1;
+    }
+    madvise((void*) in, size, MADV_SEQUENTIAL);
+  }
+  close(fd);
+
+  FILE *out=fopen(argv[optind+1], "w");
+  if(out==NULL) {
+    fprintf(stderr,"could not open %s\n", argv[optind+1]);
+    return 1;
+  }
+  setvbuf(out, NULL, _IOFBF, 1<<20);
+
+  sphinx_oprf_rec *recs=malloc(BATCH*sizeof(sphinx_oprf_rec));
+  uint8_t (*rwd)[crypto_generichash_BYTES]=malloc(BATCH*crypto_generichash_BYTES);
+  if(recs==NULL || rwd==NULL) return 1;
+
+  size_t pos=0, total=0, failed=0, n, i;
+  int ret=0;
+  while(pos<size) {
+    // index the next batch of records
+    for(n=0;n<BATCH && pos<size;n++) {
+      if(size-pos<HDR) break;
+      const size_t len=(in[pos+HDR-2]<<8) | in[pos+HDR-1];
+      if(size-pos-HDR<len) break;
+      recs[n]=(sphinx_oprf_rec) { .k=in+pos, .pwd=in+pos+HDR, .pwd_len=len };
+      pos+=HDR+len;
+    }
+    if(n<BATCH && pos<size) {
+      fprintf(stderr, "truncated record at offset %zu\n", pos);
+      ret=1;
+      pos=size;
+    }
+
+    if(sphinx_oprf_bulk(recs, n, keyfile?key:NULL, key_len, rwd, threads)!=0) {
+      size_t zero=0;
+      for(i=0;i<n;i++) {
+        if(sodium_is_zero(rwd[i], sizeof rwd[i])) {
+          fprintf(stderr, "failed to evaluate record %zu\n", total+i);
+          zero++;
+        }
+      }
+      // a failure must never go unnoticed, even if no record was left zero
+      if(zero==0) {
+        fprintf(stderr, "failed to evaluate records %zu-%zu\n", total, total+n-1);
+        ret=1;
+      }
+      failed+=zero;
+    }
+
+    for(i=0;i<n;i++) {
+      if(hex) {
+        char h[crypto_generichash_BYTES*2+1];
+        fprintf(out, "%s\n", sodium_bin2hex(h, sizeof h, rwd[i], sizeof rwd[i]));
+      } else {
+        fwrite(rwd[i], sizeof rwd[i], 1, out);
+      }
+    }
+    total+=n;
+  }
+
+  sodium_memzero(rwd, BATCH*crypto_generichash_BYTES);
+  free(rwd);
+  free(recs);
+  if(fclose(out)!=0) {
+    fprintf(stderr, "failed to write %s\n", argv[optind+1]);
+    ret=1;
+  }
+  if(in!=NULL) munmap((void*) in, size);
+  fprintf(stderr, "%zu records, %zu failed\n", total, failed);
+  return ret || failed;
+}
@@ -0,0 +1,309 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sodium.h>
+#include "../sphinx.h"
+#include "../sphinx_wire.h"
+#include "../sphinx_keytab.h"
+#include "net.h"
+
+/* loadgen - drives a responder with blinded challenges and reports
+ * latency percentiles.
+ *
+ * open loop (-r rate): requests are scheduled at fixed intervals and
+ * latency is measured from the scheduled start, so a stalled responder
+ * is charged for the requests that queued up behind it (no coordinated
+ * omission).
+ *
+ * closed loop (no -r): each of the -c workers sends back to back. With
+ * -i the latencies are corrected for coordinated omission like
+ * HdrHistogram's recordValueWithExpectedInterval does.
+ */
+
+// log-linear histogram with 3 significant digits, values in ns
+#define SUB_BITS 11
+#define SUB_HALF (1<<(SUB_BITS-1))
+#define MAG_MAX 30 // up to ~2^41ns ~ 36 minutes
+#define HIST_SIZE ((MAG_MAX+2)*SUB_HALF)
+
+typedef struct {
+  uint64_t counts[HIST_SIZE];
+  uint64_t total, max, requests, errors;
+} Hist;
+
+static size_t hist_index(uint64_t v) {
+  unsigned mag=63-__builtin_clzll(v|((1ULL<<SUB_BITS)-1))-(SUB_BITS-1);
+  if(mag>MAG_MAX) {
+    mag=MAG_MAX;
+    v=((uint64_t) (1<<SUB_BITS)<<mag)-1;
+  }
+  return ((size_t) mag<<(SUB_BITS-1)) + (v>>mag);
+}
+
+static uint64_t hist_value(size_t idx) {
+  if(idx<(1<<SUB_BITS)) return idx;
+  unsigned mag=(idx>>(SUB_BITS-1))-1;
+  return (uint64_t) (idx-((size_t) mag<<(SUB_BITS-1)))<<mag;
+}
+
+static void hist_record(Hist *h, uint64_t v) {
+  h->counts[hist_index(v)]++;
+  h->total++;
+  if(v>h->max) h->max=v;
+}
+
+// HdrHistogram style correction for coordinated omission
+static void hist_record_corrected(Hist *h, uint64_t v, uint64_t interval) {
+  hist_record(h, v);
+  if(interval==0) return;
+  uint64_t missing;
+  for(missing=v-interval;missing>=interval && missing<v;missing-=interval)
+    hist_record(h, missing);
+}
+
+static void hist_merge(Hist *dst, const Hist *src) {
+  size_t i;
+  for(i=0;i<HIST_SIZE;i++) dst->counts[i]+=src->counts[i];
+  dst->total+=src->total;
+  dst->requests+=src->requests;
+  dst->errors+=src->errors;
+  if(src->max>dst->max) dst->max=src->max;
+}
+
+static uint64_t hist_percentile(const Hist *h, double p) {
+  uint64_t want=(uint64_t) (p/100.0*h->total+0.5), seen=0;
+  if(want==0) want=1;
+  size_t i;
+  for(i=0;i<HIST_SIZE;i++) {
+    seen+=h->counts[i];
+    if(seen>=want) return hist_value(i);
+  }
+  return h->max;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec*1000000000ULL+ts.tv_nsec;
+}
+
+// relative sleeps, macOS has no clock_nanosleep()
+static void sleep_until(uint64_t t) {
+  uint64_t now;
+  while((now=now_ns())<t) {
+    const uint64_t d=t-now;
+    const struct timespec ts={ .tv_sec=d/1000000000ULL, .tv_nsec=d%1000000000ULL };
+    nanosleep(&ts, NULL);
+  }
+}
+
+#define NCHALS 1024
+
+static struct {
+  const char *sock;
+  uint8_t auth[crypto_generichash_KEYBYTES_MAX];
+  size_t auth_len;
+  uint64_t rate, interval, start, end;
+  uint8_t ids[NCHALS][SPHINX_WIRE_ID_BYTES];
+  uint8_t chals[NCHALS][SPHINX_255_SER_BYTES];
+  uint8_t secret[SPHINX_255_SCALAR_BYTES];
+  atomic_uint_fast64_t next;
+} cfg;
+
+typedef struct {
+  pthread_t thread;
+  unsigned id;
+  int fd;
+  uint32_t reqid;
+  Hist hist;
+} Worker;
+
+// one request/response round trip, returns 0 on success
+static int request(Worker *w, const uint64_t i) {
+  uint8_t resp[SPHINX_255_SER_BYTES];
+  if(cfg.sock==NULL) return sphinx_respond(cfg.chals[i%NCHALS], cfg.secret, resp);
+
+  uint8_t req[SPHINX_WIRE_CHAL_BYTES], out[SPHINX_WIRE_RESP_BYTES];
+  const uint8_t *auth=cfg.auth_len?cfg.auth:NULL;
+  sphinx_wire_msg msg;
+  sphinx_wire_challenge(req, ++w->reqid, cfg.ids[i%NCHALS], cfg.chals[i%NCHALS], auth, cfg.auth_len);
+  if(w->fd==-1) w->fd=net_connect(cfg.sock);
+  if(w->fd==-1) return -1;
+  if(net_write(w->fd, req, sizeof req)!=0 ||
+     net_read(w->fd, out, sizeof out)!=0) {
+    close(w->fd);
+    w->fd=-1;
+    return -1;
+  }
+  if(sphinx_wire_parse(out, sizeof out, req, auth, cfg.auth_len, &msg)!=SPHINX_WIRE_RESP_BYTES ||
+     msg.type!=SPHINX_WIRE_RESPONSE || msg.reqid!=w->reqid || msg.status!=SPHINX_WIRE_OK)
+    return -1;
+  return 0;
+}
+
+static void* open_loop(void *arg) {
+  Worker *w=arg;
+  const uint64_t period=1000000000ULL/cfg.rate;
+  for(;;) {
+    uint64_t i=atomic_fetch_add(&cfg.next, 1);
+    uint64_t intended=cfg.start+i*period;
+    if(intended>=cfg.end) break;
+    sleep_until(intended);
+    if(request(w, i)!=0) w->hist.errors++;
+    w->hist.requests++;
+    hist_record(&w->hist, now_ns()-intended);
+  }
+  return NULL;
+}
+
+static void* closed_loop(void *arg) {
+  Worker *w=arg;
+  uint64_t i=w->id, t;
+  while((t=now_ns())<cfg.end) {
+    if(request(w, i++)!=0) w->hist.errors++;
+    w->hist.requests++;
+    hist_record_corrected(&w->hist, now_ns()-t, cfg.interval);
+  }
+  return NULL;
+}
+
+// cycles through the key ids of a key image, the secrets are not kept
+static int read_ids(const char *path) {
+  uint8_t rec[SPHINX_KEYTAB_REC_BYTES];
+  unsigned n=0, i;
+  FILE *f=fopen(path, "r");
+  if(f==NULL) {
+    fprintf(stderr, "could not open %s\n", path);
+    return 1;
+  }
+  while(n<NCHALS && fread(rec, 1, sizeof rec, f)==sizeof rec)
+    memcpy(cfg.ids[n++], rec, SPHINX_WIRE_ID_BYTES);
+  sodium_memzero(rec, sizeof rec);
+  fclose(f);
+  if(n==0) {
+    fprintf(stderr, "no keys in %s\n", path);
+    return 1;
+  }
+  for(i=n;i<NCHALS;i++) memcpy(cfg.ids[i], cfg.ids[i%n], SPHINX_WIRE_ID_BYTES);
+  return 0;
+}
+
+static void usage(const char *prg) {
+  fprintf(stderr, "usage: %s [-u socket] [-a authkey] [-k keyimage] [-r rate] [-c concurrency] [-d seconds] [-i interval_us]\n"
+          "  -u  talk to a respondd on this unix socket, default in-process sphinx_respond()\n"
+          "  -a  authenticate requests to the respondd with the key in this file\n"
+          "  -k  use the key ids of this respondd key image, default random ids\n"
+          "  -r  open loop at this many requests/s, default closed loop\n"
+          "  -c  number of workers (default 1 closed loop, 16 open loop)\n"
+          "  -d  duration of the run in seconds (default 10)\n"
+          "  -i  closed loop expected interval for coordinated omission correction\n", prg);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  unsigned conc=0, secs=10, i;
+  const char *authfile=NULL, *keyfile=NULL;
+  int opt;
+  while((opt=getopt(argc, argv, "u:a:k:r:c:d:i:h"))!=-1) {
+    switch(opt) {
+    case 'u': cfg.sock=optarg; break;
+    case 'a': authfile=optarg; break;
+    case 'k': keyfile=optarg; break;
+    case 'r': cfg.rate=strtoull(optarg, NULL, 10); break;
+    case 'c': conc=atoi(optarg); break;
+    case 'd': secs=atoi(optarg); break;
+    case 'i': cfg.interval=strtoull(optarg, NULL, 10)*1000; break;
+    default: usage(argv[0]);
+    }
+  }
+  if(conc==0) conc=cfg.rate?16:1;
+  if(secs==0 || cfg.rate>1000000000ULL) usage(argv[0]);
+  if(sodium_init()==-1) return 1;
+  signal(SIGPIPE, SIG_IGN);
+
+  if(authfile!=NULL) {
+    FILE *f = fopen(authfile, "r");
+    if(f==NULL) {
+      fprintf(stderr,"could not open %s\n", authfile);
+      return 1;
+    }
+    cfg.auth_len=fread(cfg.auth, 1, sizeof cfg.auth, f);
+    fclose(f);
+    if(cfg.auth_len<crypto_generichash_KEYBYTES_MIN) {
+      fprintf(stderr, "expected at least %dB key in %s\n", crypto_generichash_KEYBYTES_MIN, authfile);
+      return 1;
+    }
+  }
+
+  if(keyfile!=NULL && read_ids(keyfile)!=0) return 1;
+
+  // realistic blinded challenges for random passwords
+  crypto_core_ristretto255_scalar_random(cfg.secret);
+  for(i=0;i<NCHALS;i++) {
+    uint8_t pwd[16], bfac[SPHINX_255_SCALAR_BYTES];
+    randombytes_buf(pwd, sizeof pwd);
+    if(keyfile==NULL) randombytes_buf(cfg.ids[i], sizeof cfg.ids[i]);
+    if(0!=sphinx_challenge(pwd, sizeof pwd, NULL, 0, bfac, cfg.chals[i])) {
+      fprintf(stderr, "failed to create challenge\n");
+      return 1;
+    }
+  }
+
+  Worker *workers=calloc(conc, sizeof(Worker));
+  Hist *all=calloc(1, sizeof(Hist));
+  if(workers==NULL || all==NULL) return 1;
+
+  cfg.start=now_ns()+10000000ULL; // give the workers time to start
+  cfg.end=cfg.start+secs*1000000000ULL;
+  for(i=0;i<conc;i++) {
+    workers[i].id=i;
+    workers[i].fd=-1;
+    if(pthread_create(&workers[i].thread, NULL, cfg.rate?open_loop:closed_loop, &workers[i])!=0) {
+      fprintf(stderr, "failed to start worker\n");
+      return 1;
+    }
+  }
+  for(i=0;i<conc;i++) {
+    pthread_join(workers[i].thread, NULL);
+    if(workers[i].fd!=-1) close(workers[i].fd);
+    hist_merge(all, &workers[i].hist);
+  }
+  const double elapsed=(now_ns()-cfg.start)/1e9;
+
+  printf("%s loop, %u workers, %s responder\n", cfg.rate?"open":"closed", conc, cfg.sock?cfg.sock:"in-process");
+  printf("requests %lu errors %lu throughput %.1f/s\n", (unsigned long) all->requests, (unsigned long) all->errors, all->requests/elapsed);
+  if(all->total>0) {
+    const double pcts[]={50, 90, 99, 99.9, 99.99};
+    for(i=0;i<sizeof pcts/sizeof pcts[0];i++)
+      printf("p%-6g %10.1fus\n", pcts[i], hist_percentile(all, pcts[i])/1000.0);
+    printf("max     %10.1fus\n", all->max/1000.0);
+  }
+
+  const int ret=all->errors?1:0;
+  free(workers);
+  free(all);
+  return ret;
+}
@@ -0,0 +1,108 @@
+#ifndef net_h
+#define net_h
+/* tiny socket helpers shared by the standalone daemons and tools
+ *
+ * a write to a connection the peer closed raises SIGPIPE, every program
+ * using these ignores it with signal(SIGPIPE, SIG_IGN) and gets EPIPE
+ * instead - MSG_NOSIGNAL would do the same per call but macOS lacks it
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+// reads exactly len bytes, returns 0 on success, -1 on error/eof
+static inline int net_read(int fd, void *buf, size_t len) {
+  uint8_t *p=buf;
+  while(len>0) {
+    ssize_t r=read(fd, p, len);
+    if(r<0 && errno==EINTR) continue;
+    if(r<=0) return -1;
+    p+=r; len-=r;
+  }
+  return 0;
+}
+
+// writes exactly len bytes, returns 0 on success, -1 on error
+static inline int net_write(int fd, const void *buf, size_t len) {
+  const uint8_t *p=buf;
+  while(len>0) {
+    ssize_t r=write(fd, p, len);
+    if(r<0 && errno==EINTR) continue;
+    if(r<=0) return -1;
+    p+=r; len-=r;
+  }
+  return 0;
+}
+
+static inline int64_t net_now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+/* reads (or writes if out) exactly len bytes before the deadline from
+ * net_now_ms(), returns 0 on success, NET_CLOSED if the peer closed
+ * the connection or -1 on timeout and other errors
+ */
+#define NET_CLOSED -2
+static inline int net_xfer_until(int fd, void *buf, size_t len, const int out, const int64_t deadline) {
+  uint8_t *p=buf;
+  while(len>0) {
+    const int64_t left=deadline-net_now_ms();
+    if(left<=0) return -1;
+    struct pollfd pfd={ .fd=fd, .events=out?POLLOUT:POLLIN };
+    const int ready=poll(&pfd, 1, (int) left);
+    if(ready<0 && errno==EINTR) continue;
+    if(ready!=1) return -1;
+    ssize_t r=out?send(fd, p, len, MSG_DONTWAIT):recv(fd, p, len, MSG_DONTWAIT);
+    if(r<0 && (errno==EINTR || errno==EAGAIN || errno==EWOULDBLOCK)) continue;
+    if(r==0 || (r<0 && (errno==EPIPE || errno==ECONNRESET))) return NET_CLOSED;
+    if(r<0) return -1;
+    p+=r; len-=r;
+  }
+  return 0;
+}
+
+static inline int net_addr(const char *path, struct sockaddr_un *addr) {
+  memset(addr, 0, sizeof *addr);
+  addr->sun_family=AF_UNIX;
+  if(strlen(path)>=sizeof addr->sun_path) return -1;
+  strcpy(addr->sun_path, path);
+  return 0;
+}
+
+// returns a listening unix socket bound to path or -1
+static inline int net_listen(const char *path) {
+  struct sockaddr_un addr;
+  if(net_addr(path, &addr)!=0) return -1;
+  int fd=socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd==-1) return -1;
+  unlink(path);
+  if(bind(fd, (struct sockaddr*) &addr, sizeof addr)!=0 || listen(fd, 128)!=0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// returns a unix socket connected to path or -1
+static inline int net_connect(const char *path) {
+  struct sockaddr_un addr;
+  if(net_addr(path, &addr)!=0) return -1;
+  int fd=socket(AF_UNIX, SOCK_STREAM, 0);
+  if(fd==-1) return -1;
+  if(connect(fd, (struct sockaddr*) &addr, sizeof addr)!=0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+#endif // net_h
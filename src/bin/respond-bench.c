@@ -0,0 +1,51 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <string.h>
+#include <sodium.h>
+#include "../sphinx.h"
+
+/* respond-bench - runs sphinx_respond() argv[1] times
+ *
+ * meant to be run under an instruction counting emulator, see
+ * tools/embedded-bench.sh: the difference between two run lengths
+ * gives the cost of one response without the process startup.
+ */
+
+int main(int argc, char** argv) {
+  unsigned long n=1, i;
+  // picks the implementations used below, once per run so it cancels out
+  if(sodium_init()==-1) return 1;
+  if(argc>1) {
+    const char *p;
+    for(n=0,p=argv[1];*p>='0' && *p<='9';p++) n=n*10+(*p-'0');
+  }
+
+  uint8_t h[crypto_core_ristretto255_HASHBYTES], secret[SPHINX_255_SCALAR_BYTES];
+  uint8_t chal[SPHINX_255_SER_BYTES], resp[SPHINX_255_SER_BYTES];
+  memset(h, 0x5a, sizeof h);
+  memset(secret, 0x17, sizeof secret);
+  crypto_core_ristretto255_from_hash(chal, h);
+
+  // every response is a valid challenge for the next round
+  for(i=0;i<n;i++) {
+    if(0!=sphinx_respond(chal, secret, resp)) return 1;
+    memcpy(chal, resp, sizeof chal);
+  }
+  return 0;
+}
@@ -0,0 +1,95 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sodium.h>
+#include "../sphinx.h"
+#include "../sphinx_wire.h"
+
+/* respond-embedded - the responder of the embedded build profile
+ *
+ * no heap and no stdio: reads challenges in the sphinx_wire.h format
+ * from stdin and writes a response for each to stdout. The secret is
+ * read from the file argv[1], an optional auth key from argv[2].
+ */
+
+static uint8_t secret[SPHINX_255_SCALAR_BYTES];
+static uint8_t auth[crypto_generichash_KEYBYTES_MAX];
+static size_t auth_len;
+
+static int xread(int fd, uint8_t *buf, size_t len) {
+  while(len>0) {
+    ssize_t r=read(fd, buf, len);
+    if(r<=0) return -1;
+    buf+=r; len-=r;
+  }
+  return 0;
+}
+
+static int xwrite(int fd, const uint8_t *buf, size_t len) {
+  while(len>0) {
+    ssize_t r=write(fd, buf, len);
+    if(r<=0) return -1;
+    buf+=r; len-=r;
+  }
+  return 0;
+}
+
+static void fail(const char *msg, const size_t len) {
+  if(write(2, msg, len)!=(ssize_t) len) {}
+  _exit(1);
+}
+#define FAIL(msg) fail(msg, sizeof(msg)-1)
+
+int main(int argc, char** argv) {
+  if(argc<2 || argc>3) FAIL("usage: respond-embedded <secret> [authkey]\n");
+  if(sodium_init()==-1) FAIL("libsodium init failed\n");
+
+  int fd=open(argv[1], O_RDONLY);
+  if(fd==-1 || xread(fd, secret, sizeof secret)!=0) FAIL("expected 32B secret\n");
+  close(fd);
+  if(argc==3) {
+    fd=open(argv[2], O_RDONLY);
+    if(fd==-1) FAIL("expected at least 16B auth key\n");
+    const ssize_t r=read(fd, auth, sizeof auth);
+    close(fd);
+    // compared signed, crypto_generichash_KEYBYTES_MIN is unsigned
+    if(r<(ssize_t) crypto_generichash_KEYBYTES_MIN) FAIL("expected at least 16B auth key\n");
+    auth_len=(size_t) r;
+  }
+
+  uint8_t req[SPHINX_WIRE_CHAL_BYTES], out[SPHINX_WIRE_RESP_BYTES], resp[SPHINX_255_SER_BYTES];
+  sphinx_wire_msg msg;
+  while(xread(0, req, SPHINX_WIRE_HDR_BYTES)==0) {
+    if(sphinx_wire_len(req)!=SPHINX_WIRE_CHAL_BYTES || req[1]!=SPHINX_WIRE_CHALLENGE) break;
+    if(xread(0, req+SPHINX_WIRE_HDR_BYTES, SPHINX_WIRE_CHAL_BYTES-SPHINX_WIRE_HDR_BYTES)!=0) break;
+
+    uint8_t status=SPHINX_WIRE_OK;
+    if(sphinx_wire_parse(req, sizeof req, NULL, auth_len?auth:NULL, auth_len, &msg)!=SPHINX_WIRE_CHAL_BYTES)
+      status=SPHINX_WIRE_EAUTH;
+    else if(0!=sphinx_respond(msg.point, secret, resp))
+      status=SPHINX_WIRE_EINVAL;
+    sphinx_wire_response(out, msg.reqid, status, resp, req, auth_len?auth:NULL, auth_len);
+    if(xwrite(1, out, sizeof out)!=0) break;
+  }
+
+  sodium_memzero(secret, sizeof secret);
+  sodium_memzero(auth, sizeof auth);
+  return 0;
+}
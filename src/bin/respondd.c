@@ -0,0 +1,176 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sodium.h>
+#include "../sphinx.h"
+#include "../sphinx_wire.h"
+#include "../sphinx_keytab.h"
+#include "net.h"
+
+/* respondd - the respond step as a daemon on a unix socket
+ *
+ * every connection is served by its own thread, a client can send any
+ * number of challenges in the sphinx_wire.h format and gets a response
+ * for each, in order. With -a every challenge must carry a valid tag
+ * for the auth key in that file and the responses are tagged too.
+ * Without -k the key id of the challenges is ignored, every challenge
+ * is answered with the one secret. With -k the secret of each key id
+ * comes from the key image in that file, see sphinx_keytab.h, which is
+ * reloaded on SIGHUP without stopping the connections.
+ */
+
+#define READERS 1024
+
+static uint8_t *secret, *auth;
+static size_t auth_len;
+static sphinx_keytab *keys;
+static const char *keyfile;
+
+static uint8_t respond(const int reader, const sphinx_wire_msg *msg, uint8_t resp[SPHINX_255_SER_BYTES]) {
+  if(keys==NULL)
+    return sphinx_respond(msg->point, secret, resp)==0?SPHINX_WIRE_OK:SPHINX_WIRE_EINVAL;
+  if(reader<0) return SPHINX_WIRE_EBUSY;
+  switch(sphinx_keytab_respond(keys, reader, msg->id, msg->point, resp)) {
+  case 0: return SPHINX_WIRE_OK;
+  case SPHINX_KEYTAB_ENOKEY: return SPHINX_WIRE_ENOKEY;
+  default: return SPHINX_WIRE_EINVAL;
+  }
+}
+
+static void* serve(void *arg) {
+  int fd=(int) (intptr_t) arg;
+  uint8_t req[SPHINX_WIRE_MAX_BYTES], out[SPHINX_WIRE_RESP_BYTES], resp[SPHINX_255_SER_BYTES];
+  sphinx_wire_msg msg;
+  const int reader=keys?sphinx_keytab_reader(keys):-1;
+
+  while(net_read(fd, req, SPHINX_WIRE_HDR_BYTES)==0) {
+    // only challenges are accepted
+    if(sphinx_wire_len(req)!=SPHINX_WIRE_CHAL_BYTES || req[1]!=SPHINX_WIRE_CHALLENGE) break;
+    if(net_read(fd, req+SPHINX_WIRE_HDR_BYTES, SPHINX_WIRE_CHAL_BYTES-SPHINX_WIRE_HDR_BYTES)!=0) break;
+
+    uint8_t status=SPHINX_WIRE_OK;
+    if(sphinx_wire_parse(req, SPHINX_WIRE_CHAL_BYTES, NULL, auth, auth_len, &msg)!=SPHINX_WIRE_CHAL_BYTES)
+      status=SPHINX_WIRE_EAUTH;
+    else
+      status=respond(reader, &msg, resp);
+    sphinx_wire_response(out, msg.reqid, status, resp, req, auth, auth_len);
+    if(net_write(fd, out, sizeof out)!=0) break;
+  }
+  if(keys!=NULL) sphinx_keytab_release(keys, reader);
+  close(fd);
+  return NULL;
+}
+
+// reloads the key image on every SIGHUP, blocked in all other threads
+static void* reloader(void *arg) {
+  sigset_t *set=arg;
+  int sig;
+  while(sigwait(set, &sig)==0) {
+    const int n=sphinx_keytab_load_file(keys, keyfile);
+    if(n<0) fprintf(stderr, "could not load keys from %s, keeping the old ones\n", keyfile);
+    else fprintf(stderr, "loaded %d keys\n", n);
+  }
+  return NULL;
+}
+
+// reads between min and max bytes from path into locked memory
+static uint8_t* read_key(const char *path, const size_t min, const size_t max, size_t *len) {
+  uint8_t *key=sodium_malloc(max);
+  if(key==NULL) return NULL;
+  FILE *f = fopen(path, "r");
+  if(f==NULL) {
+    fprintf(stderr,"could not open %s\n", path);
+    sodium_free(key);
+    return NULL;
+  }
+  *len=fread(key, 1, max, f);
+  fclose(f);
+  if(*len<min) {
+    fprintf(stderr, "expected at least %zuB key in %s\n", min, path);
+    sodium_free(key);
+    return NULL;
+  }
+  sodium_mprotect_readonly(key);
+  return key;
+}
+
+static void usage(const char *prg) {
+  fprintf(stderr, "usage: %s [-a authkey] <secret> <socket>\n"
+          "       %s [-a authkey] -k keyimage <socket>\n", prg, prg);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  const char *authfile=NULL;
+  size_t len;
+  int opt;
+  while((opt=getopt(argc, argv, "a:k:h"))!=-1) {
+    switch(opt) {
+    case 'a': authfile=optarg; break;
+    case 'k': keyfile=optarg; break;
+    default: usage(argv[0]);
+    }
+  }
+  if(argc-optind!=(keyfile?1:2)) usage(argv[0]);
+  if(sodium_init()==-1) return 1;
+  signal(SIGPIPE, SIG_IGN);
+
+  if(keyfile==NULL) {
+    secret=read_key(argv[optind++], SPHINX_255_SCALAR_BYTES, SPHINX_255_SCALAR_BYTES, &len);
+    if(secret==NULL) return 1;
+  } else {
+    keys=sphinx_keytab_new(READERS);
+    if(keys==NULL) return 1;
+    if(sphinx_keytab_load_file(keys, keyfile)<0) {
+      fprintf(stderr, "could not load keys from %s\n", keyfile);
+      return 1;
+    }
+    static sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGHUP);
+    pthread_t t;
+    if(pthread_sigmask(SIG_BLOCK, &set, NULL)!=0 ||
+       pthread_create(&t, NULL, reloader, &set)!=0) return 1;
+  }
+  if(authfile!=NULL) {
+    auth=read_key(authfile, crypto_generichash_KEYBYTES_MIN, crypto_generichash_KEYBYTES_MAX, &auth_len);
+    if(auth==NULL) return 1;
+  }
+
+  int lfd=net_listen(argv[optind]);
+  if(lfd==-1) {
+    fprintf(stderr, "could not listen on %s\n", argv[optind]);
+    return 1;
+  }
+
+  for(;;) {
+    int fd=accept(lfd, NULL, NULL);
+    if(fd==-1) continue;
+    pthread_t t;
+    if(pthread_create(&t, NULL, serve, (void*) (intptr_t) fd)!=0) {
+      close(fd);
+      continue;
+    }
+    pthread_detach(t);
+  }
+}
@@ -0,0 +1,387 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sodium.h>
+#include "../sphinx_wire.h"
+#include "net.h"
+
+/* router - spreads the respond step over several respondd shards
+ *
+ * the key id of every challenge is mapped onto a consistent hash ring
+ * with -v virtual nodes per shard, the challenge is forwarded to the
+ * first shard clockwise from it over a pooled persistent connection.
+ * If that shard does not answer within -t milliseconds the next of the
+ * -r distinct shards on the ring (the replicas, which must hold the
+ * same key) is tried. Adding or removing a shard only moves the keys
+ * between it and its ring neighbours.
+ *
+ * The shards are listed in a file, one unix socket path per line, it
+ * is re-read on SIGHUP. Messages are forwarded unchanged, so the tags
+ * of authenticated challenges and responses are checked end to end.
+ */
+
+#define POOL_MAX 16
+
+typedef struct Shard {
+  struct Shard *next;
+  char path[108];
+  pthread_mutex_t lock;
+  int idle[POOL_MAX];
+  unsigned nidle;
+} Shard;
+
+typedef struct {
+  uint64_t point;
+  Shard *shard;
+} Vnode;
+
+typedef struct {
+  unsigned refs, nshards, nvnodes;
+  Shard **shards;
+  Vnode *vnodes;
+} Ring;
+
+static struct {
+  unsigned vnodes, replicas;
+  int timeout;
+  const char *file;
+  // shards are never freed, a shard removed from the ring just stays idle
+  Shard *shards;
+  Ring *ring;
+  pthread_mutex_t lock;
+  volatile sig_atomic_t reload;
+} cfg = { .vnodes=128, .replicas=2, .timeout=100, .lock=PTHREAD_MUTEX_INITIALIZER };
+
+static uint64_t hash64(const uint8_t *in, const size_t len, const uint32_t salt) {
+  uint8_t h[8], s[4]={ salt>>24, salt>>16, salt>>8, salt };
+  crypto_generichash_state state;
+  crypto_generichash_init(&state, NULL, 0, sizeof h);
+  crypto_generichash_update(&state, in, len);
+  crypto_generichash_update(&state, s, sizeof s);
+  crypto_generichash_final(&state, h, sizeof h);
+  uint64_t r=0;
+  unsigned i;
+  for(i=0;i<sizeof h;i++) r=(r<<8)|h[i];
+  return r;
+}
+
+static int vnode_cmp(const void *a, const void *b) {
+  const Vnode *x=a, *y=b;
+  return (x->point>y->point)-(x->point<y->point);
+}
+
+// called with cfg.lock held
+static Shard* shard_get(const char *path) {
+  Shard *s;
+  for(s=cfg.shards;s!=NULL;s=s->next)
+    if(strcmp(s->path, path)==0) return s;
+  const size_t len=strlen(path);
+  if(len>=sizeof s->path) {
+    fprintf(stderr, "socket path too long: %s\n", path);
+    return NULL;
+  }
+  s=calloc(1, sizeof(Shard));
+  if(s==NULL) return NULL;
+  memcpy(s->path, path, len+1);
+  pthread_mutex_init(&s->lock, NULL);
+  s->next=cfg.shards;
+  cfg.shards=s;
+  return s;
+}
+
+static void ring_free(Ring *r) {
+  free(r->shards);
+  free(r->vnodes);
+  free(r);
+}
+
+// builds a ring of the shards in the file, skipping the last one if drop_last
+static Ring* ring_load(const char *file, const int drop_last) {
+  FILE *f=fopen(file, "r");
+  if(f==NULL) {
+    fprintf(stderr, "could not open %s\n", file);
+    return NULL;
+  }
+  Ring *r=calloc(1, sizeof(Ring));
+  char line[256];
+  while(r!=NULL && fgets(line, sizeof line, f)!=NULL) {
+    line[strcspn(line, "\r\n")]=0;
+    if(line[0]==0 || line[0]=='#') continue;
+    Shard **shards=realloc(r->shards, (r->nshards+1)*sizeof(Shard*));
+    if(shards==NULL) break;
+    r->shards=shards;
+    pthread_mutex_lock(&cfg.lock);
+    r->shards[r->nshards]=shard_get(line);
+    pthread_mutex_unlock(&cfg.lock);
+    if(r->shards[r->nshards]!=NULL) r->nshards++;
+  }
+  fclose(f);
+  if(r==NULL) return NULL;
+  if(drop_last && r->nshards>0) r->nshards--;
+  if(r->nshards==0) {
+    fprintf(stderr, "no shards in %s\n", file);
+    ring_free(r);
+    return NULL;
+  }
+
+  r->nvnodes=r->nshards*cfg.vnodes;
+  r->vnodes=malloc(r->nvnodes*sizeof(Vnode));
+  if(r->vnodes==NULL) {
+    ring_free(r);
+    return NULL;
+  }
+  unsigned i, v;
+  for(i=0;i<r->nshards;i++) {
+    const Shard *s=r->shards[i];
+    for(v=0;v<cfg.vnodes;v++)
+      r->vnodes[i*cfg.vnodes+v]=(Vnode) { hash64((const uint8_t*) s->path, strlen(s->path), v), r->shards[i] };
+  }
+  qsort(r->vnodes, r->nvnodes, sizeof(Vnode), vnode_cmp);
+  r->refs=1;
+  return r;
+}
+
+// the first n distinct shards clockwise of the key id, returns how many were found
+static unsigned ring_lookup(const Ring *r, const uint8_t id[SPHINX_WIRE_ID_BYTES], Shard **out, const unsigned n) {
+  const uint64_t h=hash64(id, SPHINX_WIRE_ID_BYTES, 0xffffffff);
+  size_t lo=0, hi=r->nvnodes;
+  while(lo<hi) {
+    size_t mid=(lo+hi)/2;
+    if(r->vnodes[mid].point<h) lo=mid+1;
+    else hi=mid;
+  }
+  unsigned found=0, i, j;
+  for(i=0;i<r->nvnodes && found<n;i++) {
+    Shard *s=r->vnodes[(lo+i)%r->nvnodes].shard;
+    for(j=0;j<found && out[j]!=s;j++);
+    if(j==found) out[found++]=s;
+  }
+  return found;
+}
+
+static Ring* ring_acquire(void) {
+  pthread_mutex_lock(&cfg.lock);
+  Ring *r=cfg.ring;
+  r->refs++;
+  pthread_mutex_unlock(&cfg.lock);
+  return r;
+}
+
+static void ring_release(Ring *r) {
+  pthread_mutex_lock(&cfg.lock);
+  const unsigned refs=--r->refs;
+  pthread_mutex_unlock(&cfg.lock);
+  if(refs==0) ring_free(r);
+}
+
+static int conn_get(Shard *s, int *pooled) {
+  int fd=-1;
+  pthread_mutex_lock(&s->lock);
+  if(s->nidle>0) fd=s->idle[--s->nidle];
+  pthread_mutex_unlock(&s->lock);
+  *pooled=(fd!=-1);
+  if(fd==-1) fd=net_connect(s->path);
+  return fd;
+}
+
+static void conn_put(Shard *s, const int fd) {
+  pthread_mutex_lock(&s->lock);
+  if(s->nidle<POOL_MAX) {
+    s->idle[s->nidle++]=fd;
+    pthread_mutex_unlock(&s->lock);
+    return;
+  }
+  pthread_mutex_unlock(&s->lock);
+  close(fd);
+}
+
+/* one round trip on fd, all of it before the deadline, returns 0 on
+ * success, NET_CLOSED if the shard closed the connection before
+ * answering or -1 on any other failure
+ */
+static int round_trip(const int fd, const uint8_t *req, const uint32_t reqid,
+                      uint8_t out[SPHINX_WIRE_RESP_BYTES], const int64_t deadline) {
+  sphinx_wire_msg msg;
+  int ret=net_xfer_until(fd, (void*) req, SPHINX_WIRE_CHAL_BYTES, 1, deadline);
+  if(ret==0) ret=net_xfer_until(fd, out, SPHINX_WIRE_RESP_BYTES, 0, deadline);
+  if(ret!=0) return ret;
+  if(sphinx_wire_parse(out, SPHINX_WIRE_RESP_BYTES, req, NULL, 0, &msg)!=SPHINX_WIRE_RESP_BYTES ||
+     msg.reqid!=reqid) return -1;
+  return 0;
+}
+
+// one round trip to a shard within the timeout, retry included, returns 0 on success
+static int forward(Shard *s, const uint8_t *req, const uint32_t reqid, uint8_t out[SPHINX_WIRE_RESP_BYTES]) {
+  const int64_t deadline=net_now_ms()+cfg.timeout;
+  int pooled, fd=conn_get(s, &pooled);
+  if(fd==-1) return -1;
+  int ret=round_trip(fd, req, reqid, out, deadline);
+  if(ret==NET_CLOSED && pooled) {
+    // the shard restarted since the connection was pooled, try a fresh one
+    close(fd);
+    fd=net_connect(s->path);
+    if(fd==-1) return -1;
+    ret=round_trip(fd, req, reqid, out, deadline);
+  }
+  if(ret!=0) {
+    // a late answer would be read by the next request, drop the connection
+    close(fd);
+    return -1;
+  }
+  conn_put(s, fd);
+  return 0;
+}
+
+static void* serve(void *arg) {
+  int fd=(int) (intptr_t) arg;
+  uint8_t req[SPHINX_WIRE_CHAL_BYTES], out[SPHINX_WIRE_RESP_BYTES];
+  Shard *replicas[8];
+  sphinx_wire_msg msg;
+
+  while(net_read(fd, req, SPHINX_WIRE_HDR_BYTES)==0) {
+    if(sphinx_wire_len(req)!=SPHINX_WIRE_CHAL_BYTES || req[1]!=SPHINX_WIRE_CHALLENGE) break;
+    if(net_read(fd, req+SPHINX_WIRE_HDR_BYTES, SPHINX_WIRE_CHAL_BYTES-SPHINX_WIRE_HDR_BYTES)!=0) break;
+    if(sphinx_wire_parse(req, sizeof req, NULL, NULL, 0, &msg)!=SPHINX_WIRE_CHAL_BYTES) break;
+
+    Ring *r=ring_acquire();
+    const unsigned n=ring_lookup(r, msg.id, replicas, cfg.replicas);
+    unsigned i;
+    for(i=0;i<n;i++)
+      if(forward(replicas[i], req, msg.reqid, out)==0) break;
+    ring_release(r);
+    if(i==n) sphinx_wire_response(out, msg.reqid, SPHINX_WIRE_EBUSY, NULL, req, NULL, 0);
+    if(net_write(fd, out, sizeof out)!=0) break;
+  }
+  close(fd);
+  return NULL;
+}
+
+static void* reloader(void *arg) {
+  (void) arg;
+  for(;;) {
+    sleep(1);
+    if(!cfg.reload) continue;
+    cfg.reload=0;
+    Ring *r=ring_load(cfg.file, 0), *old;
+    if(r==NULL) continue;
+    pthread_mutex_lock(&cfg.lock);
+    old=cfg.ring;
+    cfg.ring=r;
+    pthread_mutex_unlock(&cfg.lock);
+    ring_release(old);
+    fprintf(stderr, "reloaded %u shards\n", r->nshards);
+  }
+  return NULL;
+}
+
+static void on_hup(int sig) {
+  (void) sig;
+  cfg.reload=1;
+}
+
+// share of n random key ids per shard and how many move without the last shard
+static int balance(const unsigned n) {
+  Ring *all=ring_load(cfg.file, 0), *less=ring_load(cfg.file, 1);
+  if(all==NULL || less==NULL) return 1;
+  const Shard *dropped=all->shards[all->nshards-1];
+  // stray counts keys that moved although their shard stayed, always 0 on a consistent ring
+  unsigned *count=calloc(all->nshards, sizeof(unsigned)), moved=0, stray=0, i, j;
+  if(count==NULL) return 1;
+  for(i=0;i<n;i++) {
+    uint8_t id[SPHINX_WIRE_ID_BYTES];
+    Shard *a, *b;
+    randombytes_buf(id, sizeof id);
+    ring_lookup(all, id, &a, 1);
+    ring_lookup(less, id, &b, 1);
+    for(j=0;all->shards[j]!=a;j++);
+    count[j]++;
+    if(a!=b) moved++;
+    if(a!=b && a!=dropped) stray++;
+  }
+  for(i=0;i<all->nshards;i++)
+    printf("%-40s %6.2f%%\n", all->shards[i]->path, 100.0*count[i]/n);
+  printf("moved without %s: %.2f%% (ideal %.2f%%)\n", dropped->path,
+         100.0*moved/n, 100.0/all->nshards);
+  printf("moved between remaining shards: %u\n", stray);
+  free(count);
+  ring_free(all);
+  ring_free(less);
+  return 0;
+}
+
+static void usage(const char *prg) {
+  fprintf(stderr, "usage: %s [-v vnodes] [-r replicas] [-t timeout_ms] <socket> <shards-file>\n"
+          "       %s [-v vnodes] -b <ids> <shards-file>\n"
+          "  -v  virtual nodes per shard (default 128)\n"
+          "  -r  number of shards tried per key id (default 2, max 8)\n"
+          "  -t  milliseconds to wait for a shard before trying the next (default 100)\n"
+          "  -b  print the distribution of this many random key ids and exit\n", prg, prg);
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  unsigned ids=0;
+  int opt;
+  while((opt=getopt(argc, argv, "v:r:t:b:h"))!=-1) {
+    switch(opt) {
+    case 'v': cfg.vnodes=atoi(optarg); break;
+    case 'r': cfg.replicas=atoi(optarg); break;
+    case 't': cfg.timeout=atoi(optarg); break;
+    case 'b': ids=atoi(optarg); break;
+    default: usage(argv[0]);
+    }
+  }
+  if(cfg.vnodes==0 || cfg.replicas==0 || cfg.replicas>8) usage(argv[0]);
+  if(sodium_init()==-1) return 1;
+  signal(SIGPIPE, SIG_IGN);
+
+  if(ids>0) {
+    if(argc-optind!=1) usage(argv[0]);
+    cfg.file=argv[optind];
+    return balance(ids);
+  }
+  if(argc-optind!=2) usage(argv[0]);
+  cfg.file=argv[optind+1];
+  cfg.ring=ring_load(cfg.file, 0);
+  if(cfg.ring==NULL) return 1;
+
+  signal(SIGHUP, on_hup);
+  pthread_t t;
+  if(pthread_create(&t, NULL, reloader, NULL)!=0) return 1;
+
+  int lfd=net_listen(argv[optind]);
+  if(lfd==-1) {
+    fprintf(stderr, "could not listen on %s\n", argv[optind]);
+    return 1;
+  }
+  for(;;) {
+    int fd=accept(lfd, NULL, NULL);
+    if(fd==-1) continue;
+    if(pthread_create(&t, NULL, serve, (void*) (intptr_t) fd)!=0) {
+      close(fd);
+      continue;
+    }
+    pthread_detach(t);
+  }
+}
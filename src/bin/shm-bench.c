@@ -0,0 +1,149 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sodium.h>
+#include "../sphinx_shm.h"
+#include "../sphinx_wire.h"
+#include "net.h"
+
+/* shm-bench - round trip latency of the respond step from another
+ * process, over the shared memory rings and over a unix socket
+ * speaking the wire format like respondd does.
+ *
+ * Both go to the same responder process and run sphinx_respond(), the
+ * in-process row times sphinx_respond() alone, so the difference to it
+ * is the cost of the transport.
+ */
+
+static uint8_t secret[SPHINX_255_SCALAR_BYTES];
+
+static void* serve_socket(void *arg) {
+  const int fd=(int) (intptr_t) arg;
+  uint8_t req[SPHINX_WIRE_CHAL_BYTES], out[SPHINX_WIRE_RESP_BYTES], resp[SPHINX_255_SER_BYTES];
+  sphinx_wire_msg msg;
+  while(net_read(fd, req, sizeof req)==0) {
+    if(sphinx_wire_parse(req, sizeof req, NULL, NULL, 0, &msg)!=SPHINX_WIRE_CHAL_BYTES) break;
+    const uint8_t status=sphinx_respond(msg.point, secret, resp)==0?SPHINX_WIRE_OK:SPHINX_WIRE_EINVAL;
+    sphinx_wire_response(out, msg.reqid, status, resp, req, NULL, 0);
+    if(net_write(fd, out, sizeof out)!=0) break;
+  }
+  return NULL;
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b) {
+  const uint64_t x=*(const uint64_t*) a, y=*(const uint64_t*) b;
+  return (x>y)-(x<y);
+}
+
+static void report(const char *name, uint64_t *lat, const unsigned n) {
+  uint64_t sum=0;
+  unsigned i;
+  for(i=0;i<n;i++) sum+=lat[i];
+  qsort(lat, n, sizeof(uint64_t), cmp);
+  printf("%-12s mean %8.2fus  p50 %8.2fus  p99 %8.2fus  max %8.2fus\n", name,
+         sum/1000.0/n, lat[n/2]/1000.0, lat[(uint64_t) n*99/100]/1000.0, lat[n-1]/1000.0);
+}
+
+int main(int argc, char** argv) {
+  const unsigned n=argc>1?(unsigned) atoi(argv[1]):10000;
+  uint8_t chal[SPHINX_255_SER_BYTES], resp[SPHINX_255_SER_BYTES];
+  uint8_t req[SPHINX_WIRE_CHAL_BYTES], out[SPHINX_WIRE_RESP_BYTES], id[SPHINX_WIRE_ID_BYTES]={0};
+  sphinx_wire_msg msg;
+  uint32_t reqid;
+  int ret, sv[2];
+  unsigned i;
+
+  if(n==0) {
+    fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+    return 1;
+  }
+  if(sodium_init()==-1) return 1;
+  signal(SIGPIPE, SIG_IGN);
+  crypto_core_ristretto255_scalar_random(secret);
+  crypto_core_ristretto255_random(chal);
+
+  sphinx_shm *seg=sphinx_shm_new(1, 64);
+  if(seg==NULL || socketpair(AF_UNIX, SOCK_STREAM, 0, sv)!=0) return 1;
+  pid_t pid=fork();
+  if(pid==-1) return 1;
+  if(pid==0) {
+    close(sv[0]);
+    pthread_t t;
+    if(pthread_create(&t, NULL, serve_socket, (void*) (intptr_t) sv[1])!=0) _exit(1);
+    sphinx_shm_serve(seg, secret, -1);
+    _exit(0);
+  }
+  close(sv[1]);
+
+  uint64_t *lat=malloc(n*sizeof(uint64_t));
+  sphinx_shm *c=sphinx_shm_attach(sphinx_shm_fd(seg));
+  if(lat==NULL || c==NULL) goto fail;
+
+  for(i=0;i<n;i++) {
+    const uint64_t start=now_ns();
+    if(sphinx_respond(chal, secret, resp)!=0) goto fail;
+    lat[i]=now_ns()-start;
+  }
+  report("in-process", lat, n);
+
+  for(i=0;i<n;i++) {
+    const uint64_t start=now_ns();
+    if(sphinx_shm_request(c, i, chal)!=0 ||
+       sphinx_shm_response(c, &reqid, &ret, resp, 1000)!=1 ||
+       reqid!=i || ret!=0) goto fail;
+    lat[i]=now_ns()-start;
+  }
+  report("shm", lat, n);
+
+  for(i=0;i<n;i++) {
+    const uint64_t start=now_ns();
+    sphinx_wire_challenge(req, i, id, chal, NULL, 0);
+    if(net_write(sv[0], req, sizeof req)!=0 ||
+       net_read(sv[0], out, sizeof out)!=0 ||
+       sphinx_wire_parse(out, sizeof out, req, NULL, 0, &msg)!=SPHINX_WIRE_RESP_BYTES ||
+       msg.reqid!=i || msg.status!=SPHINX_WIRE_OK) goto fail;
+    lat[i]=now_ns()-start;
+  }
+  report("unix socket", lat, n);
+
+  kill(pid, SIGTERM);
+  waitpid(pid, NULL, 0);
+  sphinx_shm_free(c);
+  sphinx_shm_free(seg);
+  free(lat);
+  return 0;
+
+ fail:
+  fprintf(stderr, "round trip failed\n");
+  kill(pid, SIGTERM);
+  return 1;
+}
@@ -62,4 +62,171 @@ echo -n "only letters, 16 chars: "
 ../2pass ul 16 <pwd0
 
 rm pwd0
+
+echo -n "load test against in-process responder: "
+LD_LIBRARY_PATH=../.. ../loadgen -d 1 >/dev/null || {
+    echo "fail"
+    exit 1
+}
+echo "ok"
+
+echo -n "load test against respondd on a unix socket: "
+LD_LIBRARY_PATH=../.. ../respondd secret respondd.sock &
+pid=$!
+sleep 1
+LD_LIBRARY_PATH=../.. ../loadgen -u respondd.sock -r 500 -d 1 >/dev/null || {
+    echo "fail"
+    kill $pid
+    exit 1
+}
+kill $pid
+rm respondd.sock
+echo "ok"
+
+echo -n "authenticated load test against respondd: "
+dd if=/dev/urandom of=authkey bs=32 count=1 2>/dev/null
+LD_LIBRARY_PATH=../.. ../respondd -a authkey secret respondd.sock &
+pid=$!
+sleep 1
+LD_LIBRARY_PATH=../.. ../loadgen -u respondd.sock -a authkey -d 1 >/dev/null || {
+    echo "fail"
+    kill $pid
+    exit 1
+}
+LD_LIBRARY_PATH=../.. ../loadgen -u respondd.sock -d 1 >/dev/null 2>&1 && {
+    echo "fail, unauthenticated requests were answered"
+    kill $pid
+    exit 1
+}
+kill $pid
+rm respondd.sock authkey
+echo "ok"
+
+echo -n "respondd key reloads during a load test: "
+dd if=/dev/urandom of=keys bs=64 count=4 2>/dev/null
+LD_LIBRARY_PATH=../.. ../respondd -k keys respondd.sock 2>/dev/null &
+pid=$!
+sleep 1
+LD_LIBRARY_PATH=../.. ../loadgen -u respondd.sock -k keys -d 2 >/dev/null &
+lpid=$!
+for i in 1 2 3 4 5; do
+    # same ids, new secrets
+    { head -c 32 keys; head -c 32 /dev/urandom; tail -c +65 keys; } >keys.new
+    mv keys.new keys
+    kill -HUP $pid
+    sleep 0.2
+done
+wait $lpid || {
+    echo "fail"
+    kill $pid
+    exit 1
+}
+LD_LIBRARY_PATH=../.. ../loadgen -u respondd.sock -d 1 >/dev/null 2>&1 && {
+    echo "fail, unknown key ids were answered"
+    kill $pid
+    exit 1
+}
+kill $pid
+rm respondd.sock keys
+echo "ok"
+
+echo -n "load test through the router with a failed shard: "
+pids=""
+for i in 0 1 2; do
+    LD_LIBRARY_PATH=../.. ../respondd secret shard$i.sock &
+    pids="$pids $!"
+    [ $i -eq 0 ] && dead=$!
+    echo shard$i.sock
+done >shards
+LD_LIBRARY_PATH=../.. ../router -t 50 router.sock shards &
+pids="$pids $!"
+sleep 1
+kill $dead
+LD_LIBRARY_PATH=../.. ../loadgen -u router.sock -d 1 >/dev/null || {
+    echo "fail"
+    kill $pids 2>/dev/null
+    exit 1
+}
+kill $pids 2>/dev/null
+rm shard0.sock shard1.sock shard2.sock router.sock
+echo "ok"
+
+echo -n "pooled router connections survive a shard restart: "
+LD_LIBRARY_PATH=../.. ../respondd secret shard0.sock &
+shard=$!
+echo shard0.sock >restart
+LD_LIBRARY_PATH=../.. ../router -r 1 router.sock restart &
+router=$!
+sleep 1
+# fills the pool, then every pooled connection goes stale
+LD_LIBRARY_PATH=../.. ../loadgen -u router.sock -d 1 >/dev/null &&
+    kill $shard && wait $shard 2>/dev/null
+LD_LIBRARY_PATH=../.. ../respondd secret shard0.sock &
+shard=$!
+sleep 1
+LD_LIBRARY_PATH=../.. ../loadgen -u router.sock -d 1 >/dev/null || {
+    echo "fail"
+    kill $shard $router 2>/dev/null
+    exit 1
+}
+kill $shard $router 2>/dev/null
+rm shard0.sock router.sock restart
+echo "ok"
+
+if command -v python3 >/dev/null; then
+echo -n "router fails over from a shard stalling mid-response: "
+# answers every request with a few bytes, then nothing
+python3 -c '
+import socket, os, threading
+s=socket.socket(socket.AF_UNIX)
+s.bind("stall.sock")
+s.listen(64)
+def stall(c):
+    while c.recv(104): c.send(b"\0"*8)
+while True: threading.Thread(target=stall, args=(s.accept()[0],), daemon=True).start()
+' &
+stall=$!
+LD_LIBRARY_PATH=../.. ../respondd secret shard1.sock &
+shard=$!
+printf "stall.sock\nshard1.sock\n" >stalling
+LD_LIBRARY_PATH=../.. ../router -r 2 -t 50 router.sock stalling &
+router=$!
+sleep 1
+LD_LIBRARY_PATH=../.. timeout 10 ../loadgen -u router.sock -d 1 >/dev/null || {
+    echo "fail"
+    kill $stall $shard $router 2>/dev/null
+    exit 1
+}
+kill $stall $shard $router 2>/dev/null
+rm -f stall.sock shard1.sock router.sock stalling
+echo "ok"
+fi
+
+echo -n "removing a shard only moves its own keys: "
+# about a third moves, all of it from the removed shard
+LD_LIBRARY_PATH=../.. ../router -b 20000 shards | awk '
+    /^moved without/ { share=$4+0 }
+    /^moved between/ { stray=$5; seen=1 }
+    END { exit !(seen && stray==0 && share<40) }' || {
+    echo "fail"
+    exit 1
+}
+rm shards
+echo "ok"
+
+echo -n "bulk oprf output is independent of the thread count: "
+i=0
+while [ $i -lt 1000 ]; do
+    head -c 32 secret; printf '\000\014'; printf 'password%04d' $i
+    i=$((i+1))
+done >records
+LD_LIBRARY_PATH=../.. ../bulk-oprf -t 1 records rwd1 2>/dev/null &&
+LD_LIBRARY_PATH=../.. ../bulk-oprf -t 4 records rwd4 2>/dev/null &&
+cmp rwd1 rwd4 >/dev/null 2>/dev/null || {
+    echo "fail"
+    exit 1
+}
+rm records rwd1 rwd4
+echo "ok"
+
 rm secret
@@ -1,4 +1,10 @@
+#ifndef SPHINX_EMBEDDED
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#endif
 #include "common.h"
+#include "probes.h"
 
 #ifdef TRACE
 void dump(const uint8_t *p, const size_t len, const char* msg) {
@@ -23,59 +29,156 @@ void a_randomscalar(unsigned char* buf) {
 }
 #endif // NORANDOM
 
-int sphinx_oprf(const uint8_t *pwd, const size_t pwd_len,
+#ifndef SPHINX_EMBEDDED
+// scratch space of one oprf evaluation, kept in locked memory
+typedef struct {
+  uint8_t h0[crypto_core_ristretto255_HASHBYTES];
+  unsigned char H0[crypto_core_ristretto255_BYTES];
+  unsigned char H0_k[crypto_core_ristretto255_BYTES];
+  crypto_generichash_state state;
+} OPRF_Scratch;
+
+static int oprf(OPRF_Scratch *s,
+                const uint8_t *pwd, const size_t pwd_len,
                 const uint8_t k[crypto_core_ristretto255_SCALARBYTES],
                 const uint8_t *key, const size_t key_len,
                 uint8_t rwd[crypto_generichash_BYTES]) {
   // F_k(pwd) = H(pwd, (H0(pwd))^k) for key k ∈ Z_q
-  uint8_t h0[crypto_core_ristretto255_HASHBYTES];
-  sodium_mlock(h0,sizeof h0);
   // hash pwd with H0
-  crypto_generichash(h0, sizeof h0, pwd, pwd_len, 0, 0); // todo add salt
+  crypto_generichash(s->h0, sizeof s->h0, pwd, pwd_len, 0, 0); // todo add salt
 #ifdef TRACE
-  dump(h0, sizeof h0, "h0");
+  dump(s->h0, sizeof s->h0, "h0");
 #endif
-  unsigned char H0[crypto_core_ristretto255_BYTES];
-  sodium_mlock(H0,sizeof H0);
-  crypto_core_ristretto255_from_hash(H0, h0);
-  sodium_munlock(h0,sizeof h0);
+  crypto_core_ristretto255_from_hash(s->H0, s->h0);
 #ifdef TRACE
-  dump(H0, sizeof H0, "H0");
+  dump(s->H0, sizeof s->H0, "H0");
 #endif
 
   // H0 ^ k
-  unsigned char H0_k[crypto_core_ristretto255_BYTES];
-  sodium_mlock(H0_k,sizeof H0_k);
-  if (crypto_scalarmult_ristretto255(H0_k, k, H0) != 0) {
-    sodium_munlock(H0,sizeof H0);
-    sodium_munlock(H0_k,sizeof H0_k);
+  PROBE1(scalarmult_entry, PROBE_SM_OPRF);
+  int sm = crypto_scalarmult_ristretto255(s->H0_k, k, s->H0);
+  PROBE2(scalarmult_return, PROBE_SM_OPRF, sm);
+  if (sm != 0) {
     return -1;
   }
-  sodium_munlock(H0,sizeof H0);
 #ifdef TRACE
-  dump(H0_k, sizeof H0_k, "H0_k");
+  dump(s->H0_k, sizeof s->H0_k, "H0_k");
 #endif
 
   // hash(pwd||H0^k)
-  crypto_generichash_state state;
-  sodium_mlock(&state, sizeof state);
   if(key != NULL) {
-     crypto_generichash_init(&state, key, key_len, 32);
+     crypto_generichash_init(&s->state, key, key_len, 32);
   } else {
-     crypto_generichash_init(&state, 0, 0, 32);
+     crypto_generichash_init(&s->state, 0, 0, 32);
   }
-  crypto_generichash_update(&state, pwd, pwd_len);
-  crypto_generichash_update(&state, H0_k, sizeof H0_k);
-  crypto_generichash_final(&state, rwd, 32);
+  crypto_generichash_update(&s->state, pwd, pwd_len);
+  crypto_generichash_update(&s->state, s->H0_k, sizeof s->H0_k);
+  crypto_generichash_final(&s->state, rwd, 32);
 #ifdef TRACE
   dump(rwd, 32, "rwd");
 #endif
-  sodium_munlock(H0_k,sizeof H0_k);
-  sodium_munlock(&state, sizeof state);
 
   return 0;
 }
 
+int sphinx_oprf(const uint8_t *pwd, const size_t pwd_len,
+                const uint8_t k[crypto_core_ristretto255_SCALARBYTES],
+                const uint8_t *key, const size_t key_len,
+                uint8_t rwd[crypto_generichash_BYTES]) {
+  PROBE1(oprf_entry, key_len);
+  OPRF_Scratch s;
+  sodium_mlock(&s, sizeof s);
+  int ret = oprf(&s, pwd, pwd_len, k, key, key_len, rwd);
+  sodium_munlock(&s, sizeof s);
+  PROBE1(oprf_return, ret);
+  return ret;
+}
+
+typedef struct {
+  void (*fn)(void *arg, const unsigned i);
+  void *arg;
+  unsigned i;
+} Task;
+
+static void* run_task(void *arg) {
+  Task *task = arg;
+  task->fn(task->arg, task->i);
+  return NULL;
+}
+
+void sphinx_parallel(const unsigned n, void (*fn)(void *arg, const unsigned i), void *arg) {
+  if(n == 0) return;
+  pthread_t *threads = malloc((n - 1) * sizeof(pthread_t));
+  Task *tasks = malloc((n - 1) * sizeof(Task));
+  uint8_t *started = calloc(n, 1);
+  unsigned i;
+  if(threads != NULL && tasks != NULL && started != NULL) {
+    for(i = 1; i < n; i++) {
+      tasks[i - 1] = (Task) { fn, arg, i };
+      started[i] = pthread_create(&threads[i - 1], NULL, run_task, &tasks[i - 1]) == 0;
+    }
+  }
+  fn(arg, 0);
+  // whatever could not be started runs on the calling thread
+  for(i = 1; i < n; i++) {
+    if(started != NULL && started[i]) pthread_join(threads[i - 1], NULL);
+    else fn(arg, i);
+  }
+  free(threads);
+  free(tasks);
+  free(started);
+}
+
+#define BULK_CHUNK 256
+
+typedef struct {
+  const sphinx_oprf_rec *recs;
+  size_t n;
+  const uint8_t *key;
+  size_t key_len;
+  uint8_t (*rwd)[crypto_generichash_BYTES];
+  atomic_size_t next;
+  atomic_int ret;
+} Bulk;
+
+static void bulk_worker(void *arg, const unsigned id) {
+  (void) id;
+  Bulk *b = arg;
+  OPRF_Scratch *s = sodium_malloc(sizeof(OPRF_Scratch));
+  if(s == NULL) {
+    atomic_store(&b->ret, -1);
+    return;
+  }
+  size_t start, i;
+  while((start = atomic_fetch_add(&b->next, BULK_CHUNK)) < b->n) {
+    const size_t end = start + BULK_CHUNK < b->n ? start + BULK_CHUNK : b->n;
+    for(i = start; i < end; i++) {
+      const sphinx_oprf_rec *r = &b->recs[i];
+      if(oprf(s, r->pwd, r->pwd_len, r->k, b->key, b->key_len, b->rwd[i]) != 0) {
+        memset(b->rwd[i], 0, crypto_generichash_BYTES);
+        atomic_store(&b->ret, -1);
+      }
+    }
+  }
+  sodium_free(s);
+}
+
+int sphinx_oprf_bulk(const sphinx_oprf_rec *recs, const size_t n,
+                     const uint8_t *key, const size_t key_len,
+                     uint8_t (*rwd)[crypto_generichash_BYTES],
+                     const unsigned nthreads) {
+  Bulk b = { .recs = recs, .n = n, .key = key, .key_len = key_len, .rwd = rwd };
+  atomic_init(&b.next, 0);
+  atomic_init(&b.ret, 0);
+  // records no worker gets to, e.g. if all their scratch allocations fail, stay zero
+  if(n > 0) memset(rwd, 0, n * crypto_generichash_BYTES);
+  // no point in threads that would not get a chunk
+  unsigned t = nthreads ? nthreads : 1;
+  if(t > (n + BULK_CHUNK - 1) / BULK_CHUNK) t = (n + BULK_CHUNK - 1) / BULK_CHUNK;
+  sphinx_parallel(t, bulk_worker, &b);
+  return atomic_load(&b.ret);
+}
+
 int sphinx_blindPW(const uint8_t *pw, const size_t pwlen, uint8_t *r, uint8_t *alpha) {
   // sets α := (H^0(pw))^r
   // hash x with H^0
@@ -98,7 +201,10 @@ int sphinx_blindPW(const uint8_t *pw, const size_t pwlen, uint8_t *r, uint8_t *a
   dump(r, 32, "r");
 #endif
   // H^0(pw)^r
-  if (crypto_scalarmult_ristretto255(alpha, r, H0) != 0) {
+  PROBE1(scalarmult_entry, PROBE_SM_BLIND);
+  int sm = crypto_scalarmult_ristretto255(alpha, r, H0);
+  PROBE2(scalarmult_return, PROBE_SM_BLIND, sm);
+  if (sm != 0) {
     sodium_munlock(H0,sizeof H0);
     return -1;
   }
@@ -109,6 +215,8 @@ int sphinx_blindPW(const uint8_t *pw, const size_t pwlen, uint8_t *r, uint8_t *a
   return 0;
 }
 
+#endif // SPHINX_EMBEDDED
+
 void sphinx_f(const uint8_t *k, const size_t k_len, const uint8_t val, uint8_t *res) {
   // hash for the result res = f_k(val)
   uint8_t v[32];
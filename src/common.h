@@ -26,6 +26,45 @@ int sphinx_oprf(const uint8_t *pwd, const size_t pwd_len,
                 const uint8_t *key, const size_t key_len,
                 uint8_t rwd[crypto_generichash_BYTES]);
 
+typedef struct {
+  const uint8_t *pwd;
+  size_t pwd_len;
+  const uint8_t *k; // crypto_core_ristretto255_SCALARBYTES
+} sphinx_oprf_rec;
+
+/*
+ * Evaluates sphinx_oprf() for n records on nthreads threads, every
+ * thread reuses one locked scratch area. rwd[i] is the result for
+ * recs[i], independent of the scheduling. Returns 0 on success, -1 if
+ * any record failed, the rwd of failed records is all zeroes, as is
+ * the rwd of records left unprocessed because no scratch area could
+ * be allocated.
+ */
+int sphinx_oprf_bulk(const sphinx_oprf_rec *recs, const size_t n,
+                     const uint8_t *key, const size_t key_len,
+                     uint8_t (*rwd)[crypto_generichash_BYTES],
+                     const unsigned nthreads);
+
+/*
+ * Runs fn(arg, i) for i in 0..n-1 each on its own thread, the calling
+ * thread runs i=0 and returns when all are done. If a thread cannot be
+ * started its share runs on the calling thread.
+ */
+void sphinx_parallel(const unsigned n, void (*fn)(void *arg, const unsigned i), void *arg);
+
+/*
+ * Argon2id v1.3 (RFC 9106) with the lanes computed in parallel,
+ * m_cost is in KiB. With lanes=1 the output is the same as
+ * crypto_pwhash(..., crypto_pwhash_ALG_ARGON2ID13) with
+ * memlimit=m_cost*1024. Returns 0 on success, -1 on error.
+ */
+int sphinx_argon2id(uint8_t *out, const uint32_t outlen,
+                    const uint8_t *pwd, const size_t pwd_len,
+                    const uint8_t *salt, const size_t salt_len,
+                    const uint8_t *secret, const size_t secret_len,
+                    const uint8_t *ad, const size_t ad_len,
+                    const uint32_t t_cost, const uint32_t m_cost, const uint32_t lanes);
+
 int sphinx_blindPW(const uint8_t *pw, const size_t pwlen, uint8_t *r, uint8_t *alpha);
 
 /*
@@ -0,0 +1,205 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sodium.h>
+#include "sphinx_keytab.h"
+
+typedef struct {
+  uint8_t id[SPHINX_KEYTAB_ID_BYTES];
+  uint8_t key[SPHINX_255_SCALAR_BYTES];
+} Rec;
+
+// immutable once published, sorted by id
+typedef struct {
+  size_t n;
+  Rec recs[];
+} Snap;
+
+// the epoch a reader entered in, 0 while it is outside
+typedef struct {
+  _Atomic uint64_t epoch;
+  atomic_int used;
+  uint8_t pad[64-sizeof(uint64_t)-sizeof(int)]; // one cache line per reader
+} Slot;
+
+struct sphinx_keytab {
+  _Atomic(Snap*) snap;
+  _Atomic uint64_t epoch;
+  pthread_mutex_t load;
+  unsigned nslots;
+  Slot *slots;
+};
+
+static int rec_cmp(const void *a, const void *b) {
+  return memcmp(((const Rec*) a)->id, ((const Rec*) b)->id, SPHINX_KEYTAB_ID_BYTES);
+}
+
+static Snap* snap_new(const size_t n) {
+  if(n>(SIZE_MAX-sizeof(Snap))/sizeof(Rec)) return NULL;
+  Snap *s=sodium_malloc(sizeof(Snap)+n*sizeof(Rec));
+  if(s!=NULL) s->n=n;
+  return s;
+}
+
+/* sorts the new snapshot, swaps it in and reclaims the old one once
+ * every reader that could have seen it has left
+ */
+static int publish(sphinx_keytab *kt, Snap *s) {
+  size_t i;
+  qsort(s->recs, s->n, sizeof(Rec), rec_cmp);
+  for(i=1;i<s->n;i++) {
+    if(rec_cmp(&s->recs[i-1], &s->recs[i])==0) {
+      sodium_free(s);
+      return -1;
+    }
+  }
+  const int n=(int) s->n;
+
+  pthread_mutex_lock(&kt->load);
+  Snap *old=atomic_exchange(&kt->snap, s);
+  // readers entering from now on see the new snapshot
+  const uint64_t e=atomic_fetch_add(&kt->epoch, 1)+1;
+  unsigned j;
+  for(j=0;j<kt->nslots;j++) {
+    uint64_t seen;
+    while((seen=atomic_load(&kt->slots[j].epoch))!=0 && seen<e) {
+      const struct timespec ts={0, 50000};
+      nanosleep(&ts, NULL);
+    }
+  }
+  pthread_mutex_unlock(&kt->load);
+
+  if(old!=NULL) sodium_free(old); // wipes it
+  return n;
+}
+
+sphinx_keytab *sphinx_keytab_new(const unsigned readers) {
+  if(readers==0) return NULL;
+  sphinx_keytab *kt=calloc(1, sizeof(sphinx_keytab));
+  if(kt==NULL) return NULL;
+  kt->slots=calloc(readers, sizeof(Slot));
+  if(kt->slots==NULL) {
+    free(kt);
+    return NULL;
+  }
+  unsigned i;
+  for(i=0;i<readers;i++) {
+    atomic_init(&kt->slots[i].epoch, 0);
+    atomic_init(&kt->slots[i].used, 0);
+  }
+  kt->nslots=readers;
+  atomic_init(&kt->snap, snap_new(0));
+  atomic_init(&kt->epoch, 1);
+  pthread_mutex_init(&kt->load, NULL);
+  if(atomic_load(&kt->snap)==NULL) {
+    sphinx_keytab_free(kt);
+    return NULL;
+  }
+  return kt;
+}
+
+void sphinx_keytab_free(sphinx_keytab *kt) {
+  if(kt==NULL) return;
+  Snap *s=atomic_load(&kt->snap);
+  if(s!=NULL) sodium_free(s);
+  pthread_mutex_destroy(&kt->load);
+  free(kt->slots);
+  free(kt);
+}
+
+int sphinx_keytab_load(sphinx_keytab *kt, const uint8_t *image, const size_t len) {
+  if(len%SPHINX_KEYTAB_REC_BYTES!=0 || len/SPHINX_KEYTAB_REC_BYTES>INT32_MAX) return -1;
+  Snap *s=snap_new(len/SPHINX_KEYTAB_REC_BYTES);
+  if(s==NULL) return -1;
+  memcpy(s->recs, image, len);
+  return publish(kt, s);
+}
+
+int sphinx_keytab_load_file(sphinx_keytab *kt, const char *path) {
+  FILE *f=fopen(path, "rb");
+  if(f==NULL) return -1;
+  // read straight into locked memory, without copies in stdio buffers
+  setvbuf(f, NULL, _IONBF, 0);
+  struct stat st;
+  if(fstat(fileno(f), &st)!=0 || st.st_size<0 || st.st_size%SPHINX_KEYTAB_REC_BYTES!=0 ||
+     st.st_size/SPHINX_KEYTAB_REC_BYTES>INT32_MAX) {
+    fclose(f);
+    return -1;
+  }
+  Snap *s=snap_new(st.st_size/SPHINX_KEYTAB_REC_BYTES);
+  if(s==NULL) {
+    fclose(f);
+    return -1;
+  }
+  const size_t len=fread(s->recs, 1, st.st_size, f);
+  fclose(f);
+  if(len!=(size_t) st.st_size) {
+    sodium_free(s);
+    return -1;
+  }
+  return publish(kt, s);
+}
+
+int sphinx_keytab_reader(sphinx_keytab *kt) {
+  unsigned i;
+  for(i=0;i<kt->nslots;i++) {
+    int free_slot=0;
+    if(atomic_compare_exchange_strong(&kt->slots[i].used, &free_slot, 1)) return (int) i;
+  }
+  return -1;
+}
+
+void sphinx_keytab_release(sphinx_keytab *kt, const int reader) {
+  if(reader<0 || (unsigned) reader>=kt->nslots) return;
+  atomic_store(&kt->slots[reader].epoch, 0);
+  atomic_store(&kt->slots[reader].used, 0);
+}
+
+int sphinx_keytab_respond(sphinx_keytab *kt, const int reader,
+                          const uint8_t id[SPHINX_KEYTAB_ID_BYTES],
+                          const uint8_t chal[SPHINX_255_SER_BYTES],
+                          uint8_t resp[SPHINX_255_SER_BYTES]) {
+  if(reader<0 || (unsigned) reader>=kt->nslots) return -1;
+  Slot *slot=&kt->slots[reader];
+
+  // enter, this store must be visible before the snapshot is loaded
+  atomic_store(&slot->epoch, atomic_load(&kt->epoch));
+  const Snap *s=atomic_load(&kt->snap);
+
+  int ret=SPHINX_KEYTAB_ENOKEY;
+  size_t lo=0, hi=s->n;
+  while(lo<hi) {
+    const size_t mid=lo+(hi-lo)/2;
+    const int c=memcmp(s->recs[mid].id, id, SPHINX_KEYTAB_ID_BYTES);
+    if(c==0) {
+      ret=sphinx_respond(chal, s->recs[mid].key, resp);
+      break;
+    }
+    if(c<0) lo=mid+1;
+    else hi=mid;
+  }
+
+  atomic_store_explicit(&slot->epoch, 0, memory_order_release);
+  return ret;
+}
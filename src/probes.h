@@ -0,0 +1,41 @@
+#ifndef probes_h
+#define probes_h
+
+/* Static (USDT) tracepoints for perf/bpftrace.
+ *
+ * If <sys/sdt.h> (systemtap-sdt-dev) is available the probes are
+ * compiled in as single nop instructions plus an ELF note, they cost
+ * nothing until a tracer attaches. Build with -DNOSDT to leave them
+ * out completely. Never pass secret material to a probe, not even the
+ * length of a password, only public sizes, return codes and phase ids,
+ * timings are taken by the tracer.
+ * See tools/latency.bt for an example.
+ */
+
+#if !defined(NOSDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SPHINX_SDT 1
+#endif
+#endif
+
+#ifdef SPHINX_SDT
+#define PROBE0(name) DTRACE_PROBE(libsphinx, name)
+#define PROBE1(name, a) DTRACE_PROBE1(libsphinx, name, a)
+#define PROBE2(name, a, b) DTRACE_PROBE2(libsphinx, name, a, b)
+#define PROBE3(name, a, b, c) DTRACE_PROBE3(libsphinx, name, a, b, c)
+#else
+#define PROBE0(name) do {} while(0)
+#define PROBE1(name, a) do {} while(0)
+#define PROBE2(name, a, b) do {} while(0)
+#define PROBE3(name, a, b, c) do {} while(0)
+#endif
+
+/* phase ids passed to the scalarmult_entry/scalarmult_return probes */
+#define PROBE_SM_CHALLENGE 1
+#define PROBE_SM_RESPOND 2
+#define PROBE_SM_FINISH 3
+#define PROBE_SM_OPRF 4
+#define PROBE_SM_BLIND 5
+
+#endif // probes_h
@@ -0,0 +1,349 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifdef __linux__
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <sodium.h>
+#include "sphinx_shm.h"
+
+#define SHM_MAGIC 0x53504831 // "SPH1"
+#define SPIN 2000 // polls before sleeping, skipped on single cpu hosts
+
+/* the request ring is the bounded queue of D. Vyukov, every cell has a
+ * sequence number telling producers and the consumer whose turn it is,
+ * the response rings only need a head and a tail as they have a single
+ * producer and consumer.
+ */
+typedef struct {
+  _Alignas(64) _Atomic uint32_t seq;
+  uint32_t reqid, gen;
+  uint16_t client;
+  int8_t ret;
+  uint8_t point[SPHINX_255_SER_BYTES];
+} Cell;
+
+// a futex word bumped on every push, waited on only by an idle consumer
+typedef struct {
+  _Atomic uint32_t word, waiters;
+} Event;
+
+typedef struct {
+  uint32_t magic, clients, slots;
+  Event ev;
+  _Alignas(64) _Atomic uint32_t head;
+  _Alignas(64) uint32_t tail;
+} Header;
+
+typedef struct {
+  _Atomic uint32_t owner; // pid of the attached process, 0 if free
+  _Atomic uint32_t gen; // bumped on every claim, stamped into requests
+  Event ev;
+  _Alignas(64) _Atomic uint32_t head;
+  _Alignas(64) _Atomic uint32_t tail;
+} Client;
+
+struct sphinx_shm {
+  int fd, client;
+  uint32_t gen; // of our claim on the client slot
+  uint32_t inflight; // requests sent but not yet collected by this client
+  // private copies, the shared header could be changed by any client
+  uint32_t clients, slots;
+  unsigned spin;
+  size_t size;
+  uint8_t *base;
+  Header *hdr;
+  Cell *req;
+};
+
+static size_t seg_size(const uint32_t clients, const uint32_t slots) {
+  return sizeof(Header)+slots*sizeof(Cell)+clients*(sizeof(Client)+slots*sizeof(Cell));
+}
+
+static unsigned spin_count(void) {
+  return sysconf(_SC_NPROCESSORS_ONLN)>1?SPIN:0;
+}
+
+static Client* client(const sphinx_shm *ctx, const unsigned i) {
+  return (Client*) (ctx->base+sizeof(Header)+ctx->slots*sizeof(Cell)+
+                    i*(sizeof(Client)+ctx->slots*sizeof(Cell)));
+}
+
+// a slot whose owner died without sphinx_shm_free() can be taken over
+static int owner_dead(const uint32_t pid) {
+  return kill((pid_t) pid, 0)==-1 && errno==ESRCH;
+}
+
+/* requests of the previous owner can still be in the request ring, the
+ * new generation tells their responses apart so they are dropped
+ */
+static int claim(Client *c, const uint32_t pid, uint32_t owner, uint32_t *gen) {
+  if(owner!=0 && !owner_dead(owner)) return 0;
+  if(!atomic_compare_exchange_strong(&c->owner, &owner, pid)) return 0;
+  *gen=atomic_fetch_add(&c->gen, 1)+1;
+  // drop responses left over by the previous owner of the slot
+  atomic_store(&c->tail, atomic_load(&c->head));
+  return 1;
+}
+
+static Cell* client_cells(Client *c) {
+  return (Cell*) (c+1);
+}
+
+static void signal_ev(Event *e) {
+  atomic_fetch_add(&e->word, 1);
+  if(atomic_load(&e->waiters)>0)
+    syscall(SYS_futex, &e->word, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+}
+
+static int64_t now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t) ts.tv_sec*1000+ts.tv_nsec/1000000;
+}
+
+/* spins a bit, then sleeps on the futex until ready() or the timeout
+ * returns 1 if ready, 0 on timeout
+ */
+static int wait_ev(Event *e, const unsigned spin, int (*ready)(void *arg), void *arg, const int timeout) {
+  unsigned i;
+  for(i=0;i<spin;i++) if(ready(arg)) return 1;
+  if(timeout==0) return ready(arg);
+
+  const int64_t deadline=now_ms()+timeout;
+  for(;;) {
+    // a push after loading seen changes the word, so the futex does not sleep
+    const uint32_t seen=atomic_load(&e->word);
+    if(ready(arg)) return 1;
+    struct timespec ts, *tsp=NULL;
+    if(timeout>0) {
+      const int64_t left=deadline-now_ms();
+      if(left<=0) return 0;
+      ts.tv_sec=left/1000;
+      ts.tv_nsec=(left%1000)*1000000;
+      tsp=&ts;
+    }
+    atomic_fetch_add(&e->waiters, 1);
+    syscall(SYS_futex, &e->word, FUTEX_WAIT, seen, tsp, NULL, 0);
+    atomic_fetch_sub(&e->waiters, 1);
+  }
+}
+
+static int req_ready(void *arg) {
+  const sphinx_shm *ctx=arg;
+  const uint32_t pos=ctx->hdr->tail;
+  const Cell *cell=&ctx->req[pos&(ctx->slots-1)];
+  return atomic_load_explicit(&cell->seq, memory_order_acquire)==pos+1;
+}
+
+static int resp_ready(void *arg) {
+  Client *c=arg;
+  return atomic_load_explicit(&c->head, memory_order_acquire)!=
+    atomic_load_explicit(&c->tail, memory_order_relaxed);
+}
+
+sphinx_shm *sphinx_shm_new(const unsigned clients, const unsigned slots) {
+  if(clients==0 || clients>UINT16_MAX || slots==0 || slots>SPHINX_SHM_SLOTS_MAX) return NULL;
+  uint32_t n=1;
+  while(n<slots) n<<=1;
+
+  sphinx_shm *ctx=calloc(1, sizeof(sphinx_shm));
+  if(ctx==NULL) return NULL;
+  ctx->client=-1;
+  ctx->spin=spin_count();
+  ctx->size=seg_size(clients, n);
+  ctx->fd=memfd_create("sphinx", MFD_CLOEXEC);
+  if(ctx->fd==-1 || ftruncate(ctx->fd, ctx->size)!=0 ||
+     (ctx->base=mmap(NULL, ctx->size, PROT_READ|PROT_WRITE, MAP_SHARED, ctx->fd, 0))==MAP_FAILED) {
+    if(ctx->fd!=-1) close(ctx->fd);
+    free(ctx);
+    return NULL;
+  }
+  // the segment is zeroed by ftruncate
+  ctx->hdr=(Header*) ctx->base;
+  ctx->req=(Cell*) (ctx->hdr+1);
+  ctx->hdr->clients=ctx->clients=clients;
+  ctx->hdr->slots=ctx->slots=n;
+  uint32_t i;
+  for(i=0;i<n;i++) atomic_init(&ctx->req[i].seq, i);
+  atomic_thread_fence(memory_order_release);
+  ctx->hdr->magic=SHM_MAGIC;
+  return ctx;
+}
+
+sphinx_shm *sphinx_shm_attach(const int fd) {
+  struct stat st;
+  Header hdr;
+  if(fstat(fd, &st)!=0 || (size_t) st.st_size<sizeof hdr ||
+     pread(fd, &hdr, sizeof hdr, 0)!=sizeof hdr) return NULL;
+  if(hdr.magic!=SHM_MAGIC || hdr.clients==0 || hdr.clients>UINT16_MAX ||
+     hdr.slots==0 || hdr.slots>SPHINX_SHM_SLOTS_MAX || (hdr.slots&(hdr.slots-1))!=0 ||
+     (size_t) st.st_size!=seg_size(hdr.clients, hdr.slots)) return NULL;
+
+  sphinx_shm *ctx=calloc(1, sizeof(sphinx_shm));
+  if(ctx==NULL) return NULL;
+  ctx->client=-1;
+  ctx->size=st.st_size;
+  ctx->spin=spin_count();
+  ctx->fd=dup(fd);
+  if(ctx->fd==-1 ||
+     (ctx->base=mmap(NULL, ctx->size, PROT_READ|PROT_WRITE, MAP_SHARED, ctx->fd, 0))==MAP_FAILED) {
+    if(ctx->fd!=-1) close(ctx->fd);
+    free(ctx);
+    return NULL;
+  }
+  ctx->hdr=(Header*) ctx->base;
+  ctx->req=(Cell*) (ctx->hdr+1);
+  ctx->clients=hdr.clients;
+  ctx->slots=hdr.slots;
+
+  const uint32_t pid=(uint32_t) getpid();
+  unsigned i, pass;
+  // free slots first, only then look for ones of crashed owners
+  for(pass=0;pass<2;pass++) {
+    for(i=0;i<hdr.clients;i++) {
+      Client *c=client(ctx, i);
+      const uint32_t owner=atomic_load(&c->owner);
+      if((owner==0)!=(pass==0)) continue;
+      if(claim(c, pid, owner, &ctx->gen)) {
+        ctx->client=i;
+        return ctx;
+      }
+    }
+  }
+  sphinx_shm_free(ctx);
+  return NULL;
+}
+
+int sphinx_shm_fd(const sphinx_shm *ctx) {
+  return ctx->fd;
+}
+
+void sphinx_shm_free(sphinx_shm *ctx) {
+  if(ctx==NULL) return;
+  if(ctx->client>=0) atomic_store(&client(ctx, ctx->client)->owner, 0);
+  munmap(ctx->base, ctx->size);
+  close(ctx->fd);
+  free(ctx);
+}
+
+int sphinx_shm_request(sphinx_shm *ctx, const uint32_t reqid,
+                       const uint8_t chal[SPHINX_255_SER_BYTES]) {
+  if(ctx->client<0) return -1;
+  Header *hdr=ctx->hdr;
+  const uint32_t mask=ctx->slots-1;
+
+  // keep room for all outstanding responses in our response ring
+  if(ctx->inflight>=ctx->slots) return -1;
+
+  Cell *cell;
+  uint32_t pos=atomic_load_explicit(&hdr->head, memory_order_relaxed);
+  for(;;) {
+    cell=&ctx->req[pos&mask];
+    const int32_t diff=(int32_t) (atomic_load_explicit(&cell->seq, memory_order_acquire)-pos);
+    if(diff==0) {
+      if(atomic_compare_exchange_weak_explicit(&hdr->head, &pos, pos+1,
+                                               memory_order_relaxed, memory_order_relaxed)) break;
+    } else if(diff<0) {
+      return -1;
+    } else {
+      pos=atomic_load_explicit(&hdr->head, memory_order_relaxed);
+    }
+  }
+  cell->reqid=reqid;
+  cell->client=ctx->client;
+  cell->gen=ctx->gen;
+  memcpy(cell->point, chal, SPHINX_255_SER_BYTES);
+  atomic_store_explicit(&cell->seq, pos+1, memory_order_release);
+  ctx->inflight++;
+  signal_ev(&hdr->ev);
+  return 0;
+}
+
+int sphinx_shm_response(sphinx_shm *ctx, uint32_t *reqid, int *ret,
+                        uint8_t resp[SPHINX_255_SER_BYTES], const int timeout) {
+  if(ctx->client<0) return 0;
+  Client *c=client(ctx, ctx->client);
+  uint32_t pos;
+  const Cell *cell;
+  for(;;) {
+    if(!wait_ev(&c->ev, ctx->spin, resp_ready, c, timeout)) return 0;
+    pos=atomic_load_explicit(&c->tail, memory_order_relaxed);
+    cell=&client_cells(c)[pos&(ctx->slots-1)];
+    if(cell->gen==ctx->gen) break;
+    // answers a request of the previous owner, queued before our claim
+    atomic_store_explicit(&c->tail, pos+1, memory_order_release);
+  }
+  *reqid=cell->reqid;
+  *ret=cell->ret;
+  memcpy(resp, cell->point, SPHINX_255_SER_BYTES);
+  atomic_store_explicit(&c->tail, pos+1, memory_order_release);
+  if(ctx->inflight>0) ctx->inflight--;
+  return 1;
+}
+
+size_t sphinx_shm_serve(sphinx_shm *ctx, const uint8_t secret[SPHINX_255_SCALAR_BYTES],
+                        const int timeout) {
+  Header *hdr=ctx->hdr;
+  const uint32_t mask=ctx->slots-1;
+  size_t served=0;
+
+  while(wait_ev(&hdr->ev, ctx->spin, req_ready, ctx, timeout)) {
+    const uint32_t pos=hdr->tail;
+    Cell *in=&ctx->req[pos&mask];
+    const uint16_t cl=in->client;
+    const uint32_t reqid=in->reqid, gen=in->gen;
+    uint8_t chal[SPHINX_255_SER_BYTES], resp[SPHINX_255_SER_BYTES];
+    memcpy(chal, in->point, sizeof chal);
+    atomic_store_explicit(&in->seq, pos+ctx->slots, memory_order_release);
+    hdr->tail=pos+1;
+    served++;
+
+    if(cl>=ctx->clients) continue;
+    Client *c=client(ctx, cl);
+    // the client that sent it is gone, its slot may have a new owner
+    if(gen!=atomic_load_explicit(&c->gen, memory_order_acquire)) continue;
+    const int ret=sphinx_respond(chal, secret, resp);
+
+    const uint32_t head=atomic_load_explicit(&c->head, memory_order_relaxed);
+    // a client that does not collect its responses loses them
+    if(head-atomic_load_explicit(&c->tail, memory_order_acquire)>=ctx->slots) continue;
+    Cell *out=&client_cells(c)[head&mask];
+    out->reqid=reqid;
+    out->gen=gen;
+    out->ret=ret;
+    if(ret==0) memcpy(out->point, resp, SPHINX_255_SER_BYTES);
+    else memset(out->point, 0, SPHINX_255_SER_BYTES);
+    atomic_store_explicit(&c->head, head+1, memory_order_release);
+    signal_ev(&c->ev);
+  }
+  return served;
+}
+
+#endif // __linux__
@@ -18,10 +18,10 @@
 #include <stdint.h>
 #include <sodium.h>
 #include "sphinx.h"
-#ifdef TRACE
+#include "probes.h"
 #include "common.h"
-#endif
 
+#ifndef SPHINX_EMBEDDED
 /* params:
  *
  * pwd, p_len: (input) the master password and its length
@@ -30,7 +30,7 @@
  * chal: (output) pointer to array of crypto_core_ristretto255_BYTES (32) bytes - the challenge
  * returns -1 on error, 0 on success
  */
-int sphinx_challenge(const uint8_t *pwd, const size_t p_len, const uint8_t *salt, const size_t salt_len, uint8_t bfac[crypto_core_ristretto255_SCALARBYTES], uint8_t chal[crypto_core_ristretto255_BYTES]) {
+static int challenge(const uint8_t *pwd, const size_t p_len, const uint8_t *salt, const size_t salt_len, uint8_t bfac[crypto_core_ristretto255_SCALARBYTES], uint8_t chal[crypto_core_ristretto255_BYTES]) {
   int ret = -1;
 #ifdef TRACE
   dump(pwd, p_len, "pwd");
@@ -62,9 +62,11 @@ int sphinx_challenge(const uint8_t *pwd, const size_t p_len, const uint8_t *salt
 #endif
 
   // chal = H0^r
+  PROBE1(scalarmult_entry, PROBE_SM_CHALLENGE);
   if (crypto_scalarmult_ristretto255(chal, bfac, H0) == 0) {
     ret = 0;
   }
+  PROBE2(scalarmult_return, PROBE_SM_CHALLENGE, ret);
   sodium_munlock(H0,sizeof H0);
 #ifdef TRACE
   dump(chal, crypto_core_ristretto255_BYTES, "alpha");
@@ -73,6 +75,15 @@ int sphinx_challenge(const uint8_t *pwd, const size_t p_len, const uint8_t *salt
   return ret;
 }
 
+int sphinx_challenge(const uint8_t *pwd, const size_t p_len, const uint8_t *salt, const size_t salt_len, uint8_t bfac[crypto_core_ristretto255_SCALARBYTES], uint8_t chal[crypto_core_ristretto255_BYTES]) {
+  PROBE1(challenge_entry, salt_len);
+  int ret = challenge(pwd, p_len, salt, salt_len, bfac, chal);
+  PROBE1(challenge_return, ret);
+  return ret;
+}
+
+#endif // SPHINX_EMBEDDED
+
 /* params
  * chal: (input) the challenge, crypto_core_ristretto255_BYTES(32) bytes array
  * secret: (input) the secret contributing, crypto_core_ristretto255_SCALARBYTES (32) bytes array
@@ -80,6 +91,7 @@ int sphinx_challenge(const uint8_t *pwd, const size_t p_len, const uint8_t *salt
  * returns -1 on error, 0 on success
  */
 int sphinx_respond(const uint8_t chal[crypto_core_ristretto255_BYTES], const uint8_t secret[crypto_core_ristretto255_SCALARBYTES], uint8_t resp[crypto_core_ristretto255_BYTES]) {
+  PROBE0(respond_entry);
 #ifdef TRACE
   dump(chal, crypto_core_ristretto255_BYTES, "alpha");
 #endif
@@ -87,26 +99,34 @@ int sphinx_respond(const uint8_t chal[crypto_core_ristretto255_BYTES], const uin
   dump(secret, crypto_core_ristretto255_SCALARBYTES, "k");
 #endif
   // Checks that chal ∈ G^∗ . If not, abort;
-  if(crypto_core_ristretto255_is_valid_point(chal)!=1) return -1;
+  if(crypto_core_ristretto255_is_valid_point(chal)!=1) {
+    PROBE1(respond_return, -1);
+    return -1;
+  }
   // server contributes k
 
+  PROBE1(scalarmult_entry, PROBE_SM_RESPOND);
   int ret = crypto_scalarmult_ristretto255(resp, secret, chal);
+  PROBE2(scalarmult_return, PROBE_SM_RESPOND, ret);
 #ifdef TRACE
   dump(resp, crypto_core_ristretto255_BYTES, "beta");
 #endif
+  PROBE1(respond_return, ret);
   return ret;
 }
 
+#ifndef SPHINX_EMBEDDED
 /* params
  * pwd: (input) the password
  * p_len: (input) the password length
  * bfac: (input) bfac from challenge(), array of crypto_core_ristretto255_SCALARBYTES (32) bytes
  * resp: (input) the response from respond(), crypto_core_ristretto255_BYTES (32) bytes array
  * salt: (input) salt for the final password hashing, crypto_pwhash_SALTBYTES bytes array
+ * params: (input) hardness of the final password hashing
  * rwd: (output) the derived password, crypto_core_ristretto255_BYTES (32) bytes array
  * returns -1 on error, 0 on success
  */
-int sphinx_finish(const uint8_t *pwd, const size_t p_len, const uint8_t bfac[crypto_core_ristretto255_SCALARBYTES], const uint8_t resp[crypto_core_ristretto255_BYTES], const uint8_t salt[crypto_pwhash_SALTBYTES], uint8_t rwd[crypto_core_ristretto255_BYTES]) {
+static int finish(const uint8_t *pwd, const size_t p_len, const uint8_t bfac[crypto_core_ristretto255_SCALARBYTES], const uint8_t resp[crypto_core_ristretto255_BYTES], const uint8_t salt[crypto_pwhash_SALTBYTES], const sphinx_pwhash_params *params, uint8_t rwd[crypto_core_ristretto255_BYTES]) {
 #ifdef TRACE
   dump(bfac, crypto_core_ristretto255_SCALARBYTES, "r");
   dump(resp, crypto_core_ristretto255_BYTES, "beta");
@@ -130,7 +150,10 @@ int sphinx_finish(const uint8_t *pwd, const size_t p_len, const uint8_t bfac[cry
   // resp^(1/bfac) = h(pwd)^secret == H0^k
   unsigned char H0_k[crypto_core_ristretto255_BYTES];
   if(-1==sodium_mlock(H0_k,sizeof H0_k)) return -1;
-  if (crypto_scalarmult_ristretto255(H0_k, ir, resp) != 0) {
+  PROBE1(scalarmult_entry, PROBE_SM_FINISH);
+  int sm = crypto_scalarmult_ristretto255(H0_k, ir, resp);
+  PROBE2(scalarmult_return, PROBE_SM_FINISH, sm);
+  if (sm != 0) {
     sodium_munlock(ir, sizeof ir);
     sodium_munlock(H0_k,sizeof H0_k);
     return -1;
@@ -163,8 +186,20 @@ int sphinx_finish(const uint8_t *pwd, const size_t p_len, const uint8_t bfac[cry
   dump(rwd0, crypto_core_ristretto255_BYTES, "rwd0");
 #endif
 
-  if (crypto_pwhash(rwd, crypto_core_ristretto255_BYTES, (const char*) rwd0, crypto_core_ristretto255_BYTES, salt,
-       crypto_pwhash_OPSLIMIT_INTERACTIVE, crypto_pwhash_MEMLIMIT_INTERACTIVE, crypto_pwhash_ALG_DEFAULT) != 0) {
+  PROBE3(pwhash_entry, params->opslimit, params->memlimit, params->lanes);
+  int ph;
+  if(params->lanes <= 1) {
+    ph = crypto_pwhash(rwd, crypto_core_ristretto255_BYTES, (const char*) rwd0, crypto_core_ristretto255_BYTES, salt,
+                       params->opslimit, params->memlimit, crypto_pwhash_ALG_ARGON2ID13);
+  } else if(params->opslimit > UINT32_MAX || params->memlimit / 1024 > UINT32_MAX) {
+    ph = -1;
+  } else {
+    ph = sphinx_argon2id(rwd, crypto_core_ristretto255_BYTES, rwd0, crypto_core_ristretto255_BYTES,
+                         salt, crypto_pwhash_SALTBYTES, NULL, 0, NULL, 0,
+                         (uint32_t) params->opslimit, (uint32_t) (params->memlimit / 1024), params->lanes);
+  }
+  PROBE1(pwhash_return, ph);
+  if (ph != 0) {
     /* out of memory */
     sodium_munlock(rwd0,sizeof rwd0);
     return -1;
@@ -176,3 +211,18 @@ int sphinx_finish(const uint8_t *pwd, const size_t p_len, const uint8_t bfac[cry
 
   return 0;
 }
+
+int sphinx_finish(const uint8_t *pwd, const size_t p_len, const uint8_t bfac[crypto_core_ristretto255_SCALARBYTES], const uint8_t resp[crypto_core_ristretto255_BYTES], const uint8_t salt[crypto_pwhash_SALTBYTES], uint8_t rwd[crypto_core_ristretto255_BYTES]) {
+  const sphinx_pwhash_params params = SPHINX_PWHASH_INTERACTIVE;
+  return sphinx_finish_params(pwd, p_len, bfac, resp, salt, &params, rwd);
+}
+
+int sphinx_finish_params(const uint8_t *pwd, const size_t p_len, const uint8_t bfac[crypto_core_ristretto255_SCALARBYTES], const uint8_t resp[crypto_core_ristretto255_BYTES], const uint8_t salt[crypto_pwhash_SALTBYTES], const sphinx_pwhash_params *params, uint8_t rwd[crypto_core_ristretto255_BYTES]) {
+  const sphinx_pwhash_params interactive = SPHINX_PWHASH_INTERACTIVE;
+  if(params == NULL) params = &interactive;
+  PROBE0(finish_entry);
+  int ret = finish(pwd, p_len, bfac, resp, salt, params, rwd);
+  PROBE1(finish_return, ret);
+  return ret;
+}
+#endif // SPHINX_EMBEDDED
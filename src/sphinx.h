@@ -8,6 +8,21 @@
 #define SPHINX_255_SCALAR_BYTES crypto_core_ristretto255_SCALARBYTES
 #define SPHINX_255_SER_BYTES crypto_core_ristretto255_BYTES
 
+#define SPHINX_PWHASH_LANES_MAX 64
+
+/* hardness of the final password hashing in sphinx_finish_params()
+ * opslimit, memlimit: like for crypto_pwhash(), memlimit in bytes
+ * lanes: argon2id parallelism, with lanes>1 the lanes are computed on
+ *        as many threads, with lanes=1 this is plain crypto_pwhash()
+ */
+typedef struct {
+  unsigned long long opslimit;
+  size_t memlimit;
+  uint32_t lanes;
+} sphinx_pwhash_params;
+
+#define SPHINX_PWHASH_INTERACTIVE { crypto_pwhash_OPSLIMIT_INTERACTIVE, crypto_pwhash_MEMLIMIT_INTERACTIVE, 1 }
+
 int sphinx_challenge(const uint8_t *pwd, const size_t p_len,
                      const uint8_t *salt,
                      const size_t salt_len,
@@ -21,5 +36,14 @@ int sphinx_finish(const uint8_t *pwd, const size_t p_len,
                   const uint8_t resp[crypto_core_ristretto255_BYTES],
                   const uint8_t salt[crypto_pwhash_SALTBYTES],
                   uint8_t rwd[crypto_core_ristretto255_BYTES]);
+/* sphinx_finish() with the given hardness, params NULL means
+ * SPHINX_PWHASH_INTERACTIVE like for sphinx_finish()
+ */
+int sphinx_finish_params(const uint8_t *pwd, const size_t p_len,
+                         const uint8_t bfac[crypto_core_ristretto255_SCALARBYTES],
+                         const uint8_t resp[crypto_core_ristretto255_BYTES],
+                         const uint8_t salt[crypto_pwhash_SALTBYTES],
+                         const sphinx_pwhash_params *params,
+                         uint8_t rwd[crypto_core_ristretto255_BYTES]);
 
 #endif // sphinx_h
@@ -0,0 +1,73 @@
+#ifndef sphinx_async_h
+#define sphinx_async_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "sphinx.h"
+
+/* non-blocking client API
+ *
+ * jobs are run by a pool of worker threads owned by the library, their
+ * results are collected with sphinx_async_poll(). The fd returned by
+ * sphinx_async_fd() becomes readable whenever there are results to
+ * collect, so it can be added to epoll/libuv/etc. event loops.
+ * Not available on windows.
+ */
+
+typedef struct sphinx_async sphinx_async;
+
+typedef enum {
+  SPHINX_ASYNC_CHALLENGE = 1,
+  SPHINX_ASYNC_FINISH = 2
+} sphinx_async_op;
+
+/* result of one job
+ * tag: the tag given when submitting the job
+ * op: the kind of the job
+ * ret: return value of sphinx_challenge() or sphinx_finish_params()
+ * bfac, chal: the output of a challenge job
+ * rwd: the output of a finish job
+ * bfac and rwd are secret, wipe them with sodium_memzero() after use
+ */
+typedef struct {
+  uint64_t tag;
+  sphinx_async_op op;
+  int ret;
+  uint8_t bfac[SPHINX_255_SCALAR_BYTES];
+  uint8_t chal[SPHINX_255_SER_BYTES];
+  uint8_t rwd[SPHINX_255_SER_BYTES];
+} sphinx_async_result;
+
+/* starts threads workers (0 means one per cpu), returns NULL on error */
+sphinx_async *sphinx_async_new(const unsigned threads);
+
+/* cancels queued jobs, waits for running ones and releases everything */
+void sphinx_async_free(sphinx_async *ctx);
+
+/* the (eventfd) file descriptor to wait for readability on */
+int sphinx_async_fd(const sphinx_async *ctx);
+
+/* queue a sphinx_challenge(), the inputs are copied
+ * returns -1 on error, 0 on success
+ */
+int sphinx_async_challenge(sphinx_async *ctx, const uint64_t tag,
+                           const uint8_t *pwd, const size_t p_len,
+                           const uint8_t *salt, const size_t salt_len);
+
+/* queue a sphinx_finish_params(), params can be NULL for
+ * SPHINX_PWHASH_INTERACTIVE, the inputs are copied
+ * returns -1 on error, 0 on success
+ */
+int sphinx_async_finish(sphinx_async *ctx, const uint64_t tag,
+                        const uint8_t *pwd, const size_t p_len,
+                        const uint8_t bfac[crypto_core_ristretto255_SCALARBYTES],
+                        const uint8_t resp[crypto_core_ristretto255_BYTES],
+                        const uint8_t salt[crypto_pwhash_SALTBYTES],
+                        const sphinx_pwhash_params *params);
+
+/* collects at most max results of finished jobs without blocking,
+ * returns the number of results stored
+ */
+size_t sphinx_async_poll(sphinx_async *ctx, sphinx_async_result *results, const size_t max);
+
+#endif // sphinx_async_h
@@ -0,0 +1,63 @@
+#ifndef sphinx_keytab_h
+#define sphinx_keytab_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "sphinx.h"
+
+/* responder key table with hot reload
+ *
+ * the keys live in an immutable snapshot built from a key image, a
+ * sequence of records of
+ *   key id (32) | secret (32)
+ * Loading an image builds a new snapshot in locked memory next to the
+ * current one and publishes it with a single atomic pointer swap, so
+ * requests are never paused. Readers only announce the epoch they
+ * entered in, the loader waits for the readers of older epochs to leave
+ * before it wipes and frees the old snapshot.
+ *
+ * Every thread answering requests claims its own reader slot, lookups
+ * through it are wait-free. Loads are serialized internally.
+ */
+
+typedef struct sphinx_keytab sphinx_keytab;
+
+#define SPHINX_KEYTAB_ID_BYTES 32
+#define SPHINX_KEYTAB_REC_BYTES (SPHINX_KEYTAB_ID_BYTES+SPHINX_255_SCALAR_BYTES)
+#define SPHINX_KEYTAB_ENOKEY 1
+
+/* an empty table for up to readers concurrent reader slots
+ * returns NULL on error
+ */
+sphinx_keytab *sphinx_keytab_new(const unsigned readers);
+
+/* wipes and frees the table, no reader may be active */
+void sphinx_keytab_free(sphinx_keytab *kt);
+
+/* replaces the keys with the ones in the image of len bytes, waits
+ * until the previous keys are not used anymore and wipes them
+ * returns the number of keys, or -1 if the image is malformed (its
+ * size is not a multiple of the record size or it has an id twice)
+ * or out of memory, in which case the old keys stay in use
+ */
+int sphinx_keytab_load(sphinx_keytab *kt, const uint8_t *image, const size_t len);
+
+/* like sphinx_keytab_load() reading the image from the file at path */
+int sphinx_keytab_load_file(sphinx_keytab *kt, const char *path);
+
+/* claims a reader slot for the calling thread, returns -1 if all are taken */
+int sphinx_keytab_reader(sphinx_keytab *kt);
+
+/* gives back a slot from sphinx_keytab_reader() */
+void sphinx_keytab_release(sphinx_keytab *kt, const int reader);
+
+/* sphinx_respond() with the secret of key id
+ * returns 0 on success, SPHINX_KEYTAB_ENOKEY if there is no such key,
+ * -1 if sphinx_respond() fails
+ */
+int sphinx_keytab_respond(sphinx_keytab *kt, const int reader,
+                          const uint8_t id[SPHINX_KEYTAB_ID_BYTES],
+                          const uint8_t chal[SPHINX_255_SER_BYTES],
+                          uint8_t resp[SPHINX_255_SER_BYTES]);
+
+#endif // sphinx_keytab_h
@@ -0,0 +1,70 @@
+#ifndef sphinx_shm_h
+#define sphinx_shm_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "sphinx.h"
+
+/* shared memory transport for the respond step between processes on
+ * the same host
+ *
+ * the responder creates a memfd segment holding one multi producer
+ * request ring and a single producer/consumer response ring for each
+ * client, every slot carries one 32 byte point plus a request id.
+ * Clients get the fd from the responder (inherited or passed with
+ * SCM_RIGHTS) and attach to it, which claims one of the client slots.
+ * The rings are lock-free, a futex is only waited on/woken when the
+ * other side has gone idle, so a round trip needs no syscalls under
+ * load.
+ *
+ * All attached clients can read the whole segment, only share it
+ * between processes that trust each other. Linux only.
+ */
+
+typedef struct sphinx_shm sphinx_shm;
+
+#define SPHINX_SHM_SLOTS_MAX 65536
+
+/* creates a segment for up to clients attached clients with rings of
+ * slots entries (rounded up to a power of two), returns NULL on error
+ */
+sphinx_shm *sphinx_shm_new(const unsigned clients, const unsigned slots);
+
+/* maps the segment fd and claims a free client slot, slots record the
+ * pid of their owner and the slot of a process that exited without
+ * sphinx_shm_free() is taken over once that process is reaped, so all
+ * clients must live in the same pid namespace. Requests the previous
+ * owner left queued are never answered to the new one
+ * returns NULL if the fd is not a valid segment or all slots are taken
+ */
+sphinx_shm *sphinx_shm_attach(const int fd);
+
+/* the memfd of the segment, to be handed to clients */
+int sphinx_shm_fd(const sphinx_shm *ctx);
+
+/* releases the client slot if attached and unmaps the segment */
+void sphinx_shm_free(sphinx_shm *ctx);
+
+/* client: queues a challenge, at most slots requests can be
+ * outstanding per client
+ * returns 0 on success, -1 if the rings are full
+ */
+int sphinx_shm_request(sphinx_shm *ctx, const uint32_t reqid,
+                       const uint8_t chal[SPHINX_255_SER_BYTES]);
+
+/* client: collects one response, waiting up to timeout milliseconds
+ * (0 does not wait, -1 waits forever), ret is the return value of
+ * sphinx_respond() on the responder side
+ * returns 1 if a response was collected, 0 on timeout
+ */
+int sphinx_shm_response(sphinx_shm *ctx, uint32_t *reqid, int *ret,
+                        uint8_t resp[SPHINX_255_SER_BYTES], const int timeout);
+
+/* responder: answers requests with sphinx_respond() until none arrive
+ * for timeout milliseconds (-1 never returns)
+ * returns the number of requests answered
+ */
+size_t sphinx_shm_serve(sphinx_shm *ctx, const uint8_t secret[SPHINX_255_SCALAR_BYTES],
+                        const int timeout);
+
+#endif // sphinx_shm_h
@@ -0,0 +1,102 @@
+#ifndef sphinx_wire_h
+#define sphinx_wire_h
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "sphinx.h"
+
+/* fixed layout wire format for the respond step
+ *
+ * every message starts with an 8 byte header
+ *   version (1) | type (1) | status (1) | flags (1) | request id (4, big endian)
+ * followed by
+ *   challenge: key id (32) | challenge (32) | tag (32)   = 104 bytes
+ *   response:  response (32) | tag (32)                  =  72 bytes
+ *
+ * The request id is copied from the challenge to the response so that
+ * requests can be pipelined on one connection. The key id tells the
+ * responder which secret to use.
+ *
+ * With an auth key the tag is a keyed BLAKE2b over all the preceding
+ * bytes of the message, keyed with sphinx_f(auth, type), so both peers
+ * prove knowledge of the auth key within the single request/response.
+ * The tag of a response also covers the key id and challenge of the
+ * challenge it answers, so it only verifies against that challenge.
+ * Without an auth key the tag is all zeroes and the auth flag unset.
+ *
+ * Encoding and parsing work directly on the caller's buffer.
+ */
+
+#define SPHINX_WIRE_VERSION 1
+#define SPHINX_WIRE_HDR_BYTES 8
+#define SPHINX_WIRE_ID_BYTES 32
+#define SPHINX_WIRE_TAG_BYTES 32
+#define SPHINX_WIRE_CHAL_BYTES (SPHINX_WIRE_HDR_BYTES+SPHINX_WIRE_ID_BYTES+SPHINX_255_SER_BYTES+SPHINX_WIRE_TAG_BYTES)
+#define SPHINX_WIRE_RESP_BYTES (SPHINX_WIRE_HDR_BYTES+SPHINX_255_SER_BYTES+SPHINX_WIRE_TAG_BYTES)
+#define SPHINX_WIRE_MAX_BYTES SPHINX_WIRE_CHAL_BYTES
+
+// message types
+#define SPHINX_WIRE_CHALLENGE 1
+#define SPHINX_WIRE_RESPONSE 2
+
+// flags
+#define SPHINX_WIRE_AUTH 1
+
+// response status codes
+#define SPHINX_WIRE_OK 0
+#define SPHINX_WIRE_EINVAL 1 // sphinx_respond() failed
+#define SPHINX_WIRE_EAUTH 2  // missing or bad tag
+#define SPHINX_WIRE_ENOKEY 3 // unknown key id
+#define SPHINX_WIRE_EBUSY 4  // no responder available
+
+// parse errors
+#define SPHINX_WIRE_ERR_FORMAT -1
+#define SPHINX_WIRE_ERR_AUTH -2
+
+/* a parsed message, the pointers point into the parsed buffer */
+typedef struct {
+  uint8_t type, status, flags;
+  uint32_t reqid;
+  const uint8_t *id;    // key id, challenges only, else NULL
+  const uint8_t *point; // the challenge or response
+  const uint8_t *tag;
+} sphinx_wire_msg;
+
+/* encodes a challenge into buf, auth can be NULL/0
+ * returns SPHINX_WIRE_CHAL_BYTES
+ */
+size_t sphinx_wire_challenge(uint8_t buf[SPHINX_WIRE_CHAL_BYTES], const uint32_t reqid,
+                             const uint8_t id[SPHINX_WIRE_ID_BYTES],
+                             const uint8_t chal[SPHINX_255_SER_BYTES],
+                             const uint8_t *auth, const size_t auth_len);
+
+/* encodes the response to the challenge message req into buf, resp
+ * can be NULL if status is not SPHINX_WIRE_OK, auth can be NULL/0 in
+ * which case req is not used
+ * returns SPHINX_WIRE_RESP_BYTES
+ */
+size_t sphinx_wire_response(uint8_t buf[SPHINX_WIRE_RESP_BYTES], const uint32_t reqid,
+                            const uint8_t status,
+                            const uint8_t resp[SPHINX_255_SER_BYTES],
+                            const uint8_t req[SPHINX_WIRE_CHAL_BYTES],
+                            const uint8_t *auth, const size_t auth_len);
+
+/* returns the full size of the message starting with the header hdr,
+ * or 0 if the version or type is not known
+ */
+size_t sphinx_wire_len(const uint8_t hdr[SPHINX_WIRE_HDR_BYTES]);
+
+/* parses the message at the start of buf into msg
+ * if auth is not NULL, the message must carry a valid tag, for a
+ * response req must then be the challenge message it answers
+ * returns the size of the message, 0 if len is too short for it,
+ * SPHINX_WIRE_ERR_FORMAT for malformed messages or
+ * SPHINX_WIRE_ERR_AUTH if the tag is missing or does not verify,
+ * in which case msg is still filled in
+ */
+int sphinx_wire_parse(const uint8_t *buf, const size_t len,
+                      const uint8_t *req,
+                      const uint8_t *auth, const size_t auth_len,
+                      sphinx_wire_msg *msg);
+
+#endif // sphinx_wire_h
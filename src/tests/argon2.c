@@ -0,0 +1,65 @@
+#include "../sphinx.h"
+#include "../common.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sodium.h>
+
+// known answer tests for the multi-lane argon2id in sphinx_finish_params()
+
+static int check(const char *name, const uint8_t *got, const char *want) {
+  char hex[SPHINX_255_SER_BYTES*2+1];
+  sodium_bin2hex(hex, sizeof hex, got, SPHINX_255_SER_BYTES);
+  if(strcmp(hex, want)!=0) {
+    fprintf(stderr, "%s: fail\n  got  %s\n  want %s\n", name, hex, want);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+int main(void) {
+  int fails=0;
+  uint8_t out[SPHINX_255_SER_BYTES];
+  if(sodium_init()==-1) return 1;
+
+  // RFC 9106 section 5.3, t=3 m=32KiB p=4 with secret and associated data
+  uint8_t pwd[32], salt[16], secret[8], ad[12];
+  memset(pwd, 1, sizeof pwd);
+  memset(salt, 2, sizeof salt);
+  memset(secret, 3, sizeof secret);
+  memset(ad, 4, sizeof ad);
+  if(0!=sphinx_argon2id(out, sizeof out, pwd, sizeof pwd, salt, sizeof salt,
+                        secret, sizeof secret, ad, sizeof ad, 3, 32, 4)) return 1;
+  fails+=check("rfc9106 argon2id", out,
+               "0d640df58d78766c08c037a34a8b53c9d01ef0452d75b65eb52520e96b01e659");
+
+  // a single lane must match libsodium
+  uint8_t ref[SPHINX_255_SER_BYTES];
+  if(0!=sphinx_argon2id(out, sizeof out, pwd, sizeof pwd, salt, sizeof salt,
+                        NULL, 0, NULL, 0, 2, 1024, 1)) return 1;
+  if(0!=crypto_pwhash(ref, sizeof ref, (const char*) pwd, sizeof pwd, salt, 2, 1024*1024, crypto_pwhash_ALG_ARGON2ID13)) return 1;
+  char want[sizeof ref*2+1];
+  sodium_bin2hex(want, sizeof want, ref, sizeof ref);
+  fails+=check("single lane vs crypto_pwhash", out, want);
+
+  // full protocol, the result does not depend on the blinding factor
+  const uint8_t password[]="shitty password";
+  const uint8_t key[SPHINX_255_SCALAR_BYTES]={1};
+  const uint8_t psalt[crypto_pwhash_SALTBYTES]={1};
+  uint8_t bfac[SPHINX_255_SCALAR_BYTES], chal[SPHINX_255_SER_BYTES], resp[SPHINX_255_SER_BYTES];
+  if(0!=sphinx_challenge(password, strlen((char*) password), psalt, sizeof psalt, bfac, chal)) return 1;
+  if(0!=sphinx_respond(chal, key, resp)) return 1;
+
+  const sphinx_pwhash_params interactive = SPHINX_PWHASH_INTERACTIVE;
+  if(0!=sphinx_finish_params(password, strlen((char*) password), bfac, resp, psalt, &interactive, out)) return 1;
+  fails+=check("finish interactive", out, "cad3c866fb1995002bffd9cb838317d20d85f94d15e8ad78d71104088c0d2c40");
+  if(0!=sphinx_finish_params(password, strlen((char*) password), bfac, resp, psalt, NULL, out)) return 1;
+  fails+=check("finish default params", out, "cad3c866fb1995002bffd9cb838317d20d85f94d15e8ad78d71104088c0d2c40");
+
+  const sphinx_pwhash_params lanes4 = { crypto_pwhash_OPSLIMIT_INTERACTIVE, 4*crypto_pwhash_MEMLIMIT_INTERACTIVE, 4 };
+  if(0!=sphinx_finish_params(password, strlen((char*) password), bfac, resp, psalt, &lanes4, out)) return 1;
+  fails+=check("finish 4 lanes, 256MB", out, "724f0abb2cbf2d76af922923ccc824d44af53b67662511b01ab9eda3e7a2fe35");
+
+  return fails;
+}
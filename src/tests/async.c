@@ -0,0 +1,61 @@
+#include "../sphinx_async.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <poll.h>
+#include <sodium.h>
+
+// runs the protocol through the async api driven by poll()
+
+#define JOBS 8
+
+static size_t wait(sphinx_async *ctx, sphinx_async_result *res, size_t max) {
+  struct pollfd pfd={ .fd=sphinx_async_fd(ctx), .events=POLLIN };
+  size_t n;
+  while((n=sphinx_async_poll(ctx, res, max))==0) {
+    if(poll(&pfd, 1, 10000)!=1) return 0;
+  }
+  return n;
+}
+
+int main(void) {
+  const uint8_t pwd[]="shitty password";
+  const uint8_t secret[SPHINX_255_SCALAR_BYTES]={1};
+  const uint8_t salt[crypto_pwhash_SALTBYTES]={1};
+  uint8_t resp[JOBS][SPHINX_255_SER_BYTES];
+  sphinx_async_result res[JOBS];
+  size_t i, n, got;
+
+  if(sodium_init()==-1) return 1;
+  sphinx_async *ctx=sphinx_async_new(2);
+  if(ctx==NULL) return 1;
+
+  for(i=0;i<JOBS;i++)
+    if(0!=sphinx_async_challenge(ctx, 100+i, pwd, strlen((char*) pwd), salt, sizeof salt)) return 1;
+  // collect in small batches so results are left over between polls
+  for(got=0;got<JOBS;got+=n) {
+    if((n=wait(ctx, res, 3))==0) return 1;
+    for(i=0;i<n;i++) {
+      if(res[i].op!=SPHINX_ASYNC_CHALLENGE || res[i].ret!=0 || res[i].tag<100 || res[i].tag>=100+JOBS) return 1;
+      if(0!=sphinx_respond(res[i].chal, secret, resp[res[i].tag-100])) return 1;
+      if(0!=sphinx_async_finish(ctx, res[i].tag, pwd, strlen((char*) pwd), res[i].bfac, resp[res[i].tag-100], salt, NULL)) return 1;
+    }
+  }
+
+  char hex[SPHINX_255_SER_BYTES*2+1];
+  for(got=0;got<JOBS;got+=n) {
+    if((n=wait(ctx, res, JOBS))==0) return 1;
+    for(i=0;i<n;i++) {
+      if(res[i].op!=SPHINX_ASYNC_FINISH || res[i].ret!=0) return 1;
+      sodium_bin2hex(hex, sizeof hex, res[i].rwd, sizeof res[i].rwd);
+      if(strcmp(hex, "cad3c866fb1995002bffd9cb838317d20d85f94d15e8ad78d71104088c0d2c40")!=0) {
+        fprintf(stderr, "job %lu: wrong rwd %s\n", (unsigned long) res[i].tag, hex);
+        return 1;
+      }
+    }
+  }
+  sodium_memzero(res, sizeof res);
+  sphinx_async_free(ctx);
+  printf("async: ok\n");
+  return 0;
+}
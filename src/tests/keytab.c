@@ -0,0 +1,94 @@
+#include "../sphinx_keytab.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sodium.h>
+
+// lookups and reloads of the key table, with a reader running during reloads
+
+#define KEYS 3
+#define RELOADS 200
+
+static uint8_t image[2][KEYS*SPHINX_KEYTAB_REC_BYTES];
+static uint8_t chal[SPHINX_255_SER_BYTES];
+static uint8_t expect[2][KEYS][SPHINX_255_SER_BYTES];
+static atomic_int stop, bad;
+
+static const uint8_t *id(const unsigned i) {
+  return image[0]+i*SPHINX_KEYTAB_REC_BYTES;
+}
+
+// every response must come from one of the two images, never from freed memory
+static void* reader(void *arg) {
+  sphinx_keytab *kt=arg;
+  uint8_t resp[SPHINX_255_SER_BYTES];
+  const int r=sphinx_keytab_reader(kt);
+  unsigned i=0;
+  if(r<0) atomic_store(&bad, 1);
+  while(!atomic_load(&stop)) {
+    i=(i+1)%KEYS;
+    if(sphinx_keytab_respond(kt, r, id(i), chal, resp)!=0 ||
+       (memcmp(resp, expect[0][i], sizeof resp)!=0 && memcmp(resp, expect[1][i], sizeof resp)!=0))
+      atomic_store(&bad, 1);
+  }
+  sphinx_keytab_release(kt, r);
+  return NULL;
+}
+
+int main(void) {
+  uint8_t resp[SPHINX_255_SER_BYTES], unknown[SPHINX_KEYTAB_ID_BYTES];
+  unsigned i, v;
+
+  if(sodium_init()==-1) return 1;
+  crypto_core_ristretto255_random(chal);
+  randombytes_buf(unknown, sizeof unknown);
+  // both images hold the same ids with different keys
+  for(i=0;i<KEYS;i++) {
+    uint8_t *rec0=image[0]+i*SPHINX_KEYTAB_REC_BYTES, *rec1=image[1]+i*SPHINX_KEYTAB_REC_BYTES;
+    randombytes_buf(rec0, SPHINX_KEYTAB_ID_BYTES);
+    memcpy(rec1, rec0, SPHINX_KEYTAB_ID_BYTES);
+    for(v=0;v<2;v++) {
+      uint8_t *key=(v?rec1:rec0)+SPHINX_KEYTAB_ID_BYTES;
+      crypto_core_ristretto255_scalar_random(key);
+      if(sphinx_respond(chal, key, expect[v][i])!=0) return 1;
+    }
+  }
+
+  sphinx_keytab *kt=sphinx_keytab_new(4);
+  if(kt==NULL) return 1;
+  const int r=sphinx_keytab_reader(kt);
+  if(r<0) return 1;
+  if(sphinx_keytab_respond(kt, r, id(0), chal, resp)!=SPHINX_KEYTAB_ENOKEY) return 1;
+  if(sphinx_keytab_load(kt, image[0], sizeof image[0])!=KEYS) return 1;
+  for(i=0;i<KEYS;i++) {
+    if(sphinx_keytab_respond(kt, r, id(i), chal, resp)!=0) return 1;
+    if(memcmp(resp, expect[0][i], sizeof resp)!=0) return 1;
+  }
+  if(sphinx_keytab_respond(kt, r, unknown, chal, resp)!=SPHINX_KEYTAB_ENOKEY) return 1;
+  printf("lookup: ok\n");
+
+  // a bad image is refused and the old keys stay
+  if(sphinx_keytab_load(kt, image[0], sizeof image[0]-1)!=-1) return 1;
+  uint8_t dup[2*SPHINX_KEYTAB_REC_BYTES];
+  memcpy(dup, image[0], SPHINX_KEYTAB_REC_BYTES);
+  memcpy(dup+SPHINX_KEYTAB_REC_BYTES, image[1], SPHINX_KEYTAB_REC_BYTES);
+  if(sphinx_keytab_load(kt, dup, sizeof dup)!=-1) return 1;
+  if(sphinx_keytab_respond(kt, r, id(1), chal, resp)!=0 || memcmp(resp, expect[0][1], sizeof resp)!=0) return 1;
+  printf("bad images: ok\n");
+
+  pthread_t t;
+  if(pthread_create(&t, NULL, reader, kt)!=0) return 1;
+  for(i=0;i<RELOADS;i++)
+    if(sphinx_keytab_load(kt, image[(i+1)%2], sizeof image[0])!=KEYS) return 1;
+  atomic_store(&stop, 1);
+  pthread_join(t, NULL);
+  if(atomic_load(&bad)) return 1;
+  if(sphinx_keytab_respond(kt, r, id(2), chal, resp)!=0 || memcmp(resp, expect[0][2], sizeof resp)!=0) return 1;
+  printf("reloads under load: ok\n");
+
+  sphinx_keytab_release(kt, r);
+  sphinx_keytab_free(kt);
+  return 0;
+}
@@ -0,0 +1,140 @@
+#include "../sphinx_shm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sodium.h>
+
+/* pipelined requests from two clients to a responder in another process,
+ * and taking over the slots of clients that died attached
+ */
+
+#define REQS 16
+
+static uint8_t expect[REQS][SPHINX_255_SER_BYTES];
+
+// collects one response, even request ids go to the first client
+static int check(sphinx_shm *c, const uint32_t odd) {
+  uint8_t resp[SPHINX_255_SER_BYTES];
+  uint32_t reqid;
+  int ret;
+  if(sphinx_shm_response(c, &reqid, &ret, resp, 1000)!=1) return 1;
+  if(reqid>=REQS || (reqid&1)!=odd) return 1;
+  // the last challenge is not a valid point
+  if(reqid==REQS-1) return ret==0;
+  return ret!=0 || memcmp(resp, expect[reqid], sizeof resp)!=0;
+}
+
+int main(void) {
+  uint8_t secret[SPHINX_255_SCALAR_BYTES], chal[REQS][SPHINX_255_SER_BYTES], resp[SPHINX_255_SER_BYTES];
+  uint32_t reqid, i;
+  int ret;
+
+  if(sodium_init()==-1) return 1;
+  crypto_core_ristretto255_scalar_random(secret);
+  for(i=0;i<REQS;i++) {
+    crypto_core_ristretto255_random(chal[i]);
+    if(sphinx_respond(chal[i], secret, expect[i])!=0) return 1;
+  }
+  memset(chal[REQS-1], 0xff, SPHINX_255_SER_BYTES);
+
+  sphinx_shm *seg=sphinx_shm_new(2, 4);
+  if(seg==NULL) return 1;
+  pid_t pid=fork();
+  if(pid==-1) return 1;
+  if(pid==0) {
+    sphinx_shm_serve(seg, secret, 1000);
+    _exit(0);
+  }
+
+  sphinx_shm *a=sphinx_shm_attach(sphinx_shm_fd(seg)), *b=sphinx_shm_attach(sphinx_shm_fd(seg));
+  if(a==NULL || b==NULL) return 1;
+  if(sphinx_shm_attach(sphinx_shm_fd(seg))!=NULL) return 1;
+
+  unsigned outstanding[2]={0, 0};
+  for(i=0;i<REQS;i++) {
+    sphinx_shm *c=(i&1)?b:a;
+    // the shared request ring or our response ring is full
+    while(sphinx_shm_request(c, i, chal[i])!=0) {
+      const unsigned j=outstanding[i&1]>0 ? (i&1) : !(i&1);
+      if(check(j?b:a, j)!=0) return 1;
+      outstanding[j]--;
+    }
+    outstanding[i&1]++;
+  }
+  for(;outstanding[0]>0;outstanding[0]--) if(check(a, 0)!=0) return 1;
+  for(;outstanding[1]>0;outstanding[1]--) if(check(b, 1)!=0) return 1;
+  if(sphinx_shm_response(a, &reqid, &ret, resp, 0)!=0) return 1;
+  printf("pipelined requests from two clients: ok\n");
+
+  sphinx_shm_free(a);
+  sphinx_shm_free(b);
+
+  // both slots end up held by killed clients
+  pid_t dead[2];
+  for(i=0;i<2;i++) {
+    int p[2];
+    char c;
+    if(pipe(p)!=0 || (dead[i]=fork())==-1) return 1;
+    if(dead[i]==0) {
+      if(sphinx_shm_attach(sphinx_shm_fd(seg))!=NULL) (void) !write(p[1], "a", 1);
+      pause();
+      _exit(0);
+    }
+    close(p[1]);
+    if(read(p[0], &c, 1)!=1) return 1;
+    close(p[0]);
+  }
+  if(sphinx_shm_attach(sphinx_shm_fd(seg))!=NULL) return 1;
+  for(i=0;i<2;i++) {
+    kill(dead[i], SIGKILL);
+    if(waitpid(dead[i], NULL, 0)!=dead[i]) return 1;
+  }
+  a=sphinx_shm_attach(sphinx_shm_fd(seg));
+  b=sphinx_shm_attach(sphinx_shm_fd(seg));
+  if(a==NULL || b==NULL) return 1;
+  if(sphinx_shm_request(a, 0, chal[0])!=0 || check(a, 0)!=0) return 1;
+  sphinx_shm_free(a);
+  sphinx_shm_free(b);
+  printf("slots of killed clients are taken over: ok\n");
+
+  int status;
+  if(waitpid(pid, &status, 0)!=pid || !WIFEXITED(status)) return 1;
+
+  // a client dies with a request queued while no responder runs
+  a=sphinx_shm_attach(sphinx_shm_fd(seg));
+  if(a==NULL) return 1;
+  int p[2];
+  char c;
+  if(pipe(p)!=0 || (pid=fork())==-1) return 1;
+  if(pid==0) {
+    sphinx_shm *d=sphinx_shm_attach(sphinx_shm_fd(seg));
+    if(d!=NULL && sphinx_shm_request(d, 1, chal[0])==0) (void) !write(p[1], "r", 1);
+    pause();
+    _exit(0);
+  }
+  close(p[1]);
+  if(read(p[0], &c, 1)!=1) return 1;
+  close(p[0]);
+  kill(pid, SIGKILL);
+  if(waitpid(pid, NULL, 0)!=pid) return 1;
+  // the next owner of its slot uses the same request id
+  b=sphinx_shm_attach(sphinx_shm_fd(seg));
+  if(b==NULL || sphinx_shm_request(b, 1, chal[1])!=0) return 1;
+  if((pid=fork())==-1) return 1;
+  if(pid==0) {
+    sphinx_shm_serve(seg, secret, 1000);
+    _exit(0);
+  }
+  if(check(b, 1)!=0) return 1;
+  if(sphinx_shm_response(b, &reqid, &ret, resp, 200)!=0) return 1;
+  sphinx_shm_free(a);
+  sphinx_shm_free(b);
+  if(waitpid(pid, &status, 0)!=pid || !WIFEXITED(status)) return 1;
+  printf("requests of killed clients are not answered to the next owner: ok\n");
+
+  sphinx_shm_free(seg);
+  return 0;
+}
@@ -0,0 +1,77 @@
+#include "../sphinx_wire.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sodium.h>
+
+// round trips and tampering for the wire format
+
+int main(void) {
+  uint8_t auth[32], id[SPHINX_WIRE_ID_BYTES], chal[SPHINX_255_SER_BYTES], resp[SPHINX_255_SER_BYTES];
+  uint8_t buf[SPHINX_WIRE_MAX_BYTES], req[SPHINX_WIRE_CHAL_BYTES], other[SPHINX_WIRE_CHAL_BYTES];
+  sphinx_wire_msg msg;
+  if(sodium_init()==-1) return 1;
+  randombytes_buf(auth, sizeof auth);
+  randombytes_buf(id, sizeof id);
+  crypto_core_ristretto255_random(chal);
+  crypto_core_ristretto255_random(resp);
+
+  // challenge round trip, parsed in place
+  if(sphinx_wire_challenge(buf, 0x01020304, id, chal, auth, sizeof auth)!=SPHINX_WIRE_CHAL_BYTES) return 1;
+  if(sphinx_wire_len(buf)!=SPHINX_WIRE_CHAL_BYTES) return 1;
+  if(sphinx_wire_parse(buf, SPHINX_WIRE_HDR_BYTES, NULL, auth, sizeof auth, &msg)!=0) return 1;
+  if(sphinx_wire_parse(buf, SPHINX_WIRE_CHAL_BYTES-1, NULL, auth, sizeof auth, &msg)!=0) return 1;
+  if(sphinx_wire_parse(buf, SPHINX_WIRE_CHAL_BYTES, NULL, auth, sizeof auth, &msg)!=SPHINX_WIRE_CHAL_BYTES) return 1;
+  if(msg.type!=SPHINX_WIRE_CHALLENGE || msg.reqid!=0x01020304 || !(msg.flags & SPHINX_WIRE_AUTH)) return 1;
+  if(msg.id!=buf+SPHINX_WIRE_HDR_BYTES || memcmp(msg.id, id, sizeof id)!=0) return 1;
+  if(memcmp(msg.point, chal, sizeof chal)!=0) return 1;
+  printf("challenge round trip: ok\n");
+
+  // any flipped bit, a wrong key or a missing tag must be rejected
+  size_t i;
+  for(i=0;i<SPHINX_WIRE_CHAL_BYTES;i++) {
+    buf[i]^=0x10;
+    int r=sphinx_wire_parse(buf, SPHINX_WIRE_CHAL_BYTES, NULL, auth, sizeof auth, &msg);
+    buf[i]^=0x10;
+    if(r>0) {
+      fprintf(stderr, "tampered byte %zu accepted\n", i);
+      return 1;
+    }
+  }
+  auth[0]^=1;
+  if(sphinx_wire_parse(buf, SPHINX_WIRE_CHAL_BYTES, NULL, auth, sizeof auth, &msg)!=SPHINX_WIRE_ERR_AUTH) return 1;
+  auth[0]^=1;
+  sphinx_wire_challenge(buf, 1, id, chal, NULL, 0);
+  if(sphinx_wire_parse(buf, SPHINX_WIRE_CHAL_BYTES, NULL, NULL, 0, &msg)!=SPHINX_WIRE_CHAL_BYTES) return 1;
+  if(sphinx_wire_parse(buf, SPHINX_WIRE_CHAL_BYTES, NULL, auth, sizeof auth, &msg)!=SPHINX_WIRE_ERR_AUTH) return 1;
+  printf("challenge tampering: ok\n");
+
+  // responses, a challenge tag must not verify as a response tag
+  sphinx_wire_challenge(req, 7, id, chal, auth, sizeof auth);
+  if(sphinx_wire_response(buf, 7, SPHINX_WIRE_OK, resp, req, auth, sizeof auth)!=SPHINX_WIRE_RESP_BYTES) return 1;
+  if(sphinx_wire_parse(buf, sizeof buf, req, auth, sizeof auth, &msg)!=SPHINX_WIRE_RESP_BYTES) return 1;
+  if(msg.type!=SPHINX_WIRE_RESPONSE || msg.reqid!=7 || msg.status!=SPHINX_WIRE_OK || msg.id!=NULL) return 1;
+  if(memcmp(msg.point, resp, sizeof resp)!=0) return 1;
+  if(sphinx_wire_parse(buf, sizeof buf, NULL, auth, sizeof auth, &msg)!=SPHINX_WIRE_ERR_AUTH) return 1;
+  buf[1]=SPHINX_WIRE_CHALLENGE;
+  if(sphinx_wire_parse(buf, sizeof buf, req, auth, sizeof auth, &msg)>0) return 1;
+  sphinx_wire_response(buf, 8, SPHINX_WIRE_ENOKEY, NULL, req, auth, sizeof auth);
+  if(sphinx_wire_parse(buf, sizeof buf, req, auth, sizeof auth, &msg)!=SPHINX_WIRE_RESP_BYTES || msg.status!=SPHINX_WIRE_ENOKEY) return 1;
+  printf("response round trip: ok\n");
+
+  // a recorded response must not verify for another challenge with the same reqid
+  uint8_t chal2[SPHINX_255_SER_BYTES], id2[SPHINX_WIRE_ID_BYTES];
+  crypto_core_ristretto255_random(chal2);
+  randombytes_buf(id2, sizeof id2);
+  sphinx_wire_response(buf, 7, SPHINX_WIRE_OK, resp, req, auth, sizeof auth);
+  sphinx_wire_challenge(other, 7, id, chal2, auth, sizeof auth);
+  if(sphinx_wire_parse(buf, sizeof buf, other, auth, sizeof auth, &msg)!=SPHINX_WIRE_ERR_AUTH) return 1;
+  sphinx_wire_challenge(other, 7, id2, chal, auth, sizeof auth);
+  if(sphinx_wire_parse(buf, sizeof buf, other, auth, sizeof auth, &msg)!=SPHINX_WIRE_ERR_AUTH) return 1;
+  printf("spliced response: ok\n");
+
+  buf[0]=SPHINX_WIRE_VERSION+1;
+  if(sphinx_wire_parse(buf, sizeof buf, NULL, NULL, 0, &msg)!=SPHINX_WIRE_ERR_FORMAT) return 1;
+  printf("unknown version: ok\n");
+  return 0;
+}
@@ -0,0 +1,33 @@
+#!/bin/sh
+# instruction count of one sphinx_respond() on an emulated device class
+#
+# usage: tools/embedded-bench.sh <qemu-user> <path/to/libinsn.so> [respond-bench]
+#   e.g. tools/embedded-bench.sh qemu-arm /usr/lib/qemu/plugins/libinsn.so
+#
+# runs the statically linked embedded/respond-bench (make embedded with a
+# cross compiler) under qemu's instruction counting plugin with 1 and
+# 101 rounds, the difference divided by 100 is the cost of one response
+# without process startup. Set CPI (cycles per instruction of the target
+# core) and MHZ to get an estimate of the response time.
+
+QEMU=${1:?qemu user mode binary, e.g. qemu-arm}
+PLUGIN=${2:?path to the libinsn.so qemu plugin}
+BENCH=${3:-embedded/respond-bench}
+
+count() {
+    "$QEMU" -plugin "$PLUGIN" -d plugin "$BENCH" "$1" 2>&1 |
+        sed -n 's/.*insns: *\([0-9][0-9]*\).*/\1/p' | tail -n 1
+}
+
+base=$(count 1)
+full=$(count 101)
+[ -n "$base" ] && [ -n "$full" ] || {
+    echo "failed to get instruction counts from $QEMU" >&2
+    exit 1
+}
+insns=$(( (full - base) / 100 ))
+echo "instructions per sphinx_respond(): $insns"
+if [ -n "$CPI" ] && [ -n "$MHZ" ]; then
+    awk -v i="$insns" -v cpi="$CPI" -v mhz="$MHZ" \
+        'BEGIN { c = i * cpi; printf("~%.0f cycles, ~%.2f ms at %d MHz\n", c, c / mhz / 1000, mhz) }'
+fi
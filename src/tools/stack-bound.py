@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""worst case stack usage and heap use from gcc -fcallgraph-info=su output
+
+usage: stack-bound.py [--lower-bound] <dir-or-.ci-file>... -- <entry function>...
+
+Walks the call graphs of all given .ci files (pass libsodium's build
+tree too, built with the same flag, to cover it), and prints for every
+entry point the deepest call chain and its stack usage. Exits with 1 if
+a heap function is reachable, the usage is unbounded (recursion,
+dynamic stack, indirect calls) or a callee has no stack information.
+
+With --lower-bound callees without stack information count as 0 bytes
+and only produce a warning, every total is then printed as a lower
+bound (>=) and the functions it leaves out are listed.
+"""
+
+import os
+import re
+import sys
+
+HEAP = {'malloc', 'calloc', 'realloc', 'free', 'posix_memalign',
+        'aligned_alloc', 'sodium_malloc', 'sodium_allocarray', 'sodium_free'}
+
+node_re = re.compile(r'node: \{ title: "([^"]+)" label: "([^"]*)"')
+edge_re = re.compile(r'edge: \{ sourcename: "([^"]+)" targetname: "([^"]+)"')
+size_re = re.compile(r'\\n(\d+) bytes \((static|dynamic[^)]*)\)')
+
+
+def load(paths):
+  frames, calls = {}, {}
+  files = []
+  for p in paths:
+    if os.path.isdir(p):
+      for root, _, names in os.walk(p):
+        files += [os.path.join(root, n) for n in names if n.endswith('.ci')]
+    else:
+      files.append(p)
+  for f in files:
+    with open(f) as fd:
+      for line in fd:
+        m = node_re.match(line)
+        if m:
+          s = size_re.search(m.group(2))
+          if s:
+            # "dynamic,bounded" frames never exceed the reported size
+            frames[m.group(1)] = (int(s.group(1)),
+                                  s.group(2) not in ('static', 'dynamic,bounded'))
+          continue
+        m = edge_re.match(line)
+        if m:
+          calls.setdefault(m.group(1), set()).add(m.group(2))
+  return frames, calls
+
+
+def main(argv):
+  if '--' not in argv:
+    print(__doc__, file=sys.stderr)
+    return 2
+  sep = argv.index('--')
+  paths = argv[1:sep]
+  lower = '--lower-bound' in paths
+  if lower:
+    paths.remove('--lower-bound')
+  frames, calls = load(paths)
+  problems = set()
+  memo = {}
+
+  def depth(fn, path):
+    if fn in path:
+      problems.add('recursion: ' + ' -> '.join(path + [fn]))
+      return 0, [fn]
+    if fn in memo:
+      return memo[fn]
+    if fn in HEAP:
+      problems.add('heap use: ' + ' -> '.join(path + [fn]))
+    if fn == '__indirect_call':
+      problems.add('indirect call in ' + path[-1])
+    if fn not in frames:
+      if fn not in HEAP and fn != '__indirect_call':
+        problems.add('no stack info: ' + fn)
+      own, dynamic = 0, False
+    else:
+      own, dynamic = frames[fn]
+    if dynamic:
+      problems.add('dynamic stack: ' + fn)
+    best, chain = 0, []
+    for callee in sorted(calls.get(fn, ())):
+      d, c = depth(callee, path + [fn])
+      if d > best or not chain:
+        best, chain = d, c
+    memo[fn] = (own + best, [fn] + chain)
+    return memo[fn]
+
+  fatal = ('recursion', 'heap use', 'dynamic stack')
+  if not lower:
+    fatal += ('no stack info',)
+  results = [depth(entry, []) for entry in argv[sep + 1:]]
+  missing = sorted(p.split(': ')[1] for p in problems if p.startswith('no stack info'))
+  for total, chain in results:
+    print('%s%6d bytes  %s' % ('>=' if missing else '  ', total, ' -> '.join(chain)))
+  if missing:
+    print('lower bounds, without: ' + ', '.join(missing))
+  for p in sorted(problems):
+    print(('warning: ' if p.split(':')[0] not in fatal else 'error: ') + p, file=sys.stderr)
+  return 1 if any(p.split(':')[0] in fatal or p.startswith('indirect') for p in problems) else 0
+
+
+if __name__ == '__main__':
+  sys.exit(main(sys.argv))
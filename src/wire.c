@@ -0,0 +1,122 @@
+/*
+    @copyright 2018, pitchfork@ctrlc.hu
+    This file is part of pitchforked sphinx.
+
+    pitchforked sphinx is free software: you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public License
+    as published by the Free Software Foundation, either version 3 of
+    the License, or (at your option) any later version.
+
+    pitchfork is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with pitchforked sphinx. If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <stdint.h>
+#include <string.h>
+#include <sodium.h>
+#include "sphinx_wire.h"
+#include "common.h"
+
+// the key id and point of the challenge a response answers
+#define BIND_BYTES (SPHINX_WIRE_ID_BYTES+SPHINX_255_SER_BYTES)
+
+/* tag = H_{f_auth(type)}(msg without the tag | bind)
+ * for responses bind is the key id and point of the challenge, so a
+ * response cannot be replayed as the answer to another challenge
+ */
+static void tag(uint8_t out[SPHINX_WIRE_TAG_BYTES], const uint8_t *msg, const size_t len,
+                const uint8_t *req, const uint8_t *auth, const size_t auth_len) {
+  uint8_t key[crypto_core_ristretto255_BYTES];
+  crypto_generichash_state state;
+  sphinx_f(auth, auth_len, msg[1], key);
+  crypto_generichash_init(&state, key, sizeof key, SPHINX_WIRE_TAG_BYTES);
+  crypto_generichash_update(&state, msg, len-SPHINX_WIRE_TAG_BYTES);
+  if(req!=NULL) crypto_generichash_update(&state, req+SPHINX_WIRE_HDR_BYTES, BIND_BYTES);
+  crypto_generichash_final(&state, out, SPHINX_WIRE_TAG_BYTES);
+  sodium_memzero(key, sizeof key);
+  sodium_memzero(&state, sizeof state);
+}
+
+static void header(uint8_t *buf, const uint8_t type, const uint8_t status, const uint32_t reqid, const int auth) {
+  buf[0]=SPHINX_WIRE_VERSION;
+  buf[1]=type;
+  buf[2]=status;
+  buf[3]=auth?SPHINX_WIRE_AUTH:0;
+  buf[4]=reqid>>24;
+  buf[5]=reqid>>16;
+  buf[6]=reqid>>8;
+  buf[7]=reqid;
+}
+
+static void seal(uint8_t *buf, const size_t len, const uint8_t *req, const uint8_t *auth, const size_t auth_len) {
+  if(auth!=NULL) tag(buf+len-SPHINX_WIRE_TAG_BYTES, buf, len, req, auth, auth_len);
+  else memset(buf+len-SPHINX_WIRE_TAG_BYTES, 0, SPHINX_WIRE_TAG_BYTES);
+}
+
+size_t sphinx_wire_challenge(uint8_t buf[SPHINX_WIRE_CHAL_BYTES], const uint32_t reqid,
+                             const uint8_t id[SPHINX_WIRE_ID_BYTES],
+                             const uint8_t chal[SPHINX_255_SER_BYTES],
+                             const uint8_t *auth, const size_t auth_len) {
+  header(buf, SPHINX_WIRE_CHALLENGE, SPHINX_WIRE_OK, reqid, auth!=NULL);
+  memcpy(buf+SPHINX_WIRE_HDR_BYTES, id, SPHINX_WIRE_ID_BYTES);
+  memcpy(buf+SPHINX_WIRE_HDR_BYTES+SPHINX_WIRE_ID_BYTES, chal, SPHINX_255_SER_BYTES);
+  seal(buf, SPHINX_WIRE_CHAL_BYTES, NULL, auth, auth_len);
+  return SPHINX_WIRE_CHAL_BYTES;
+}
+
+size_t sphinx_wire_response(uint8_t buf[SPHINX_WIRE_RESP_BYTES], const uint32_t reqid,
+                            const uint8_t status,
+                            const uint8_t resp[SPHINX_255_SER_BYTES],
+                            const uint8_t req[SPHINX_WIRE_CHAL_BYTES],
+                            const uint8_t *auth, const size_t auth_len) {
+  header(buf, SPHINX_WIRE_RESPONSE, status, reqid, auth!=NULL);
+  if(status==SPHINX_WIRE_OK && resp!=NULL) memcpy(buf+SPHINX_WIRE_HDR_BYTES, resp, SPHINX_255_SER_BYTES);
+  else memset(buf+SPHINX_WIRE_HDR_BYTES, 0, SPHINX_255_SER_BYTES);
+  seal(buf, SPHINX_WIRE_RESP_BYTES, req, auth, auth_len);
+  return SPHINX_WIRE_RESP_BYTES;
+}
+
+size_t sphinx_wire_len(const uint8_t hdr[SPHINX_WIRE_HDR_BYTES]) {
+  if(hdr[0]!=SPHINX_WIRE_VERSION) return 0;
+  switch(hdr[1]) {
+  case SPHINX_WIRE_CHALLENGE: return SPHINX_WIRE_CHAL_BYTES;
+  case SPHINX_WIRE_RESPONSE: return SPHINX_WIRE_RESP_BYTES;
+  default: return 0;
+  }
+}
+
+int sphinx_wire_parse(const uint8_t *buf, const size_t len,
+                      const uint8_t *req,
+                      const uint8_t *auth, const size_t auth_len,
+                      sphinx_wire_msg *msg) {
+  if(len<SPHINX_WIRE_HDR_BYTES) return 0;
+  const size_t size=sphinx_wire_len(buf);
+  if(size==0) return SPHINX_WIRE_ERR_FORMAT;
+  if(len<size) return 0;
+
+  msg->type=buf[1];
+  msg->status=buf[2];
+  msg->flags=buf[3];
+  msg->reqid=((uint32_t) buf[4]<<24) | ((uint32_t) buf[5]<<16) | ((uint32_t) buf[6]<<8) | buf[7];
+  if(msg->type==SPHINX_WIRE_CHALLENGE) {
+    msg->id=buf+SPHINX_WIRE_HDR_BYTES;
+    msg->point=msg->id+SPHINX_WIRE_ID_BYTES;
+  } else {
+    msg->id=NULL;
+    msg->point=buf+SPHINX_WIRE_HDR_BYTES;
+  }
+  msg->tag=buf+size-SPHINX_WIRE_TAG_BYTES;
+
+  if(auth!=NULL) {
+    uint8_t t[SPHINX_WIRE_TAG_BYTES];
+    if(msg->type==SPHINX_WIRE_RESPONSE && req==NULL) return SPHINX_WIRE_ERR_AUTH;
+    tag(t, buf, size, msg->type==SPHINX_WIRE_RESPONSE?req:NULL, auth, auth_len);
+    if(!(msg->flags & SPHINX_WIRE_AUTH) || crypto_verify_32(t, msg->tag)!=0)
+      return SPHINX_WIRE_ERR_AUTH;
+  }
+  return (int) size;
+}